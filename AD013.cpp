@@ -9,74 +9,41 @@
 
 // Local Include
 #include "AD013.h"
+#include "AD013_Log.h"
+#include "AD013_Timer.h"
+#include "AD013_Transport.h"
 
-// Uses this library to harmonize support
-// for meaningful output across boards
-#include <LibPrintf.h>
+// POSIX tty Support
+#ifdef AD013_HOST_BUILD
+#include <termios.h>
+#endif
+
+// SIMD Checksum Support
+#if defined(AD013_HOST_BUILD) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // Global Definitions
-#define AD013_MSG_HEADER_SIZE     10
-#define AD013_MAX_ACK_BUFF_SIZE   20
-#define AD013_MAX_BIN_BUFF_SIZE  128
-
-// Message Offsets
-#define AD013_MSG_OFFSET_HEADER    0
-#define AD013_MSG_OFFSET_DEVID     2
-#define AD013_MSG_OFFSET_FLAG      6
-#define AD013_MSG_OFFSET_LENGTH    7
-#define AD013_MSG_OFFSET_CODE      9
-#define AD013_MSG_OFFSET_DATA     10
-
-// Debugging Messaging
-#ifdef AD013_DEBUG
-#define AD013_DEBUG_IS_ENABLED     1
+#define AD013_MAX_ACK_BUFF_SIZE   48
+#define AD013_MAX_BIN_BUFF_SIZE  AD013_MAX_PACKET_SIZE
+#define AD013_READ_BLOCK_SIZE      32 /* Stack block for AD013_ReadSum() */
+#define AD013_DEF_TIMEOUT        1000
+#define AD013_RECV_QUIET_MS        20 /* Line idle time ending AD013_RecvFlush() */
+#define AD013_SESSION_MAGIC      0xAD0135E5UL
+
+// System Registers (PS_WriteReg)
+#define AD013_REG_BAUD_RATE         4 /* N x 9600 baud */
+#define AD013_REG_SECURITY_LEVEL    5
+#define AD013_REG_PACKET_SIZE       6 /* 0: 32, 1: 64, 2: 128, 3: 256 */
+
+// Image Quality Block Sums (16-bit unless a block's gradient,
+// up to 255 x (2 x size - 1) x size, can overflow them)
+#if 255L * (2 * AD013_QUALITY_BLOCK_SIZE - 1) * AD013_QUALITY_BLOCK_SIZE > 0xFFFF
+typedef uint32_t AD013_BlockSum;
 #else
-#define AD013_DEBUG_IS_ENABLED     0
+typedef uint16_t AD013_BlockSum;
 #endif
 
-typedef enum {
-  AD013_CODE_OK                     = 0x00,
-  AD013_CODE_ERROR                  = 0x01,
-  AD013_CODE_NO_FINGER              = 0x02,
-  AD013_CODE_IMAGE_FAIL             = 0x03,
-  AD013_CODE_FEATURE_FAIL_LIGTH_DRY = 0x04,
-  AD013_CODE_FEATURE_FAIL_DARK_WET  = 0x05,
-  AD013_CODE_FEATURE_FAIL_AMORPHOUS = 0x06,
-  AD013_CODE_FEATURE_FAIL_MINUTIAE  = 0x07,
-  AD013_CODE_FINGER_NOT_MATCHED     = 0x08,
-  AD013_CODE_FINGER_NOT_FOUND       = 0x09,
-  AD013_CODE_FEATURE_FAIL_MERGE     = 0x0A,
-  AD013_CODE_TEMLATE_DB_RANGE_ERROR = 0x0B,
-  AD013_CODE_TEMPLATE_READ_ERROR    = 0x0C,
-  AD013_CODE_FEATURE_UPLOAD_FAIL    = 0x0D,
-  AD013_CODE_DATA_RECEIVE_ERROR     = 0x0E,
-  AD013_CODE_DATA_IMAGE_UPLOAD_FAIL = 0x0F,
-  AD013_CODE_DELETE_FAIL            = 0x10,
-  AD013_CODE_TEMPLATE_DB_CLEAR_FAIL = 0x11,
-  AD013_CODE_LOW_POWER_MODE_ERROR   = 0x12,
-  AD013_CODE_PASSWORD_ERROR         = 0x13,
-  AD013_CODE_RESET_FAIL             = 0x14,
-  AD013_CODE_IMAGE_INCOMPLETE_ERROR = 0x15,
-  AD013_CODE_ONLINE_UPGRADE_FAIL    = 0x16,
-  AD013_CODE_IMAGE_STILL_DATA_ERROR = 0x17,
-  AD013_CODE_FLASH_READ_WRITE_ERROR = 0x18,
-  AD013_CODE_GENERIC_ERROR          = 0x19,
-  AD013_CODE_DATA_RECEIVED_OK       = 0xF0, /* Ack with 0xF0 after receiving data correctly */
-  AD013_CODE_DATA_CONTINUE_ACK      = 0xF1,
-  AD013_CODE_FLASH_SUM_ERROR        = 0xF2,
-  AD013_CODE_FLASH_FLAG_ERROR       = 0xF3,
-  AD013_CODE_FLASH_PKT_LENGTH_ERROR = 0xF4,
-  AD013_CODE_FLASH_CODE_TOO_LONG    = 0xF5,
-  AD013_CODE_FLASH_ERROR            = 0xF6,
-  AD013_CODE_REGISTER_NUMBER_ERROR  = 0x1A,
-  AD013_CODE_REGISTER_WRONG_DISTRO_NUMBER = 0x1B,
-  AD013_CODE_NOTEPAD_PAGE_NUMBER_ERROR = 0x1C,
-  AD013_CODE_PORT_OP_FAIL           = 0x1D,
-  AD013_CODE_AUTO_ENROLL_FAIL       = 0x1E,
-  AD013_CODE_TEMPLATE_DB_FULL       = 0x1F
-  /* 0x20 - 0xEF Reserved Values */
-} AD013_CODE;
-
                         // ================
                         // Global Variables
                         // ================
@@ -92,6 +59,70 @@ AD013_Params AD013_DefaultParams = {
   0          // Param Length (Zero is Empty)
 };
 
+// Template Cache (Slot -> Content Hash)
+typedef struct template_cache_st {
+  uint32_t hash;      /* CRC32 of the last fetched/stored contents */
+  uint8_t  gen;       /* Bumped on every store/delete of the slot */
+  uint8_t  hash_gen;  /* Generation the hash refers to */
+} AD013_TemplateCacheEntry;
+
+// Data Packet Size configured in the sensor (default is 128)
+static int AD013_PacketSize = 128;
+
+static AD013_TemplateCacheEntry AD013_TemplateCache[AD013_TEMPLATE_CACHE_SIZE] = { { 0x00 } };
+
+// Match Cache (recent successful searches)
+typedef struct match_cache_st {
+  uint32_t      hash;   /* SimHash of the searched Char */
+  unsigned long time;   /* millis() of the match */
+  int16_t       id;     /* Matched Template */
+  uint16_t      score;
+  bool          used;
+} AD013_MatchCacheEntry;
+
+#define AD013_MATCH_CACHE_SLOTS   (AD013_MATCH_CACHE_SIZE > 0 ? AD013_MATCH_CACHE_SIZE : 1)
+
+static AD013_MatchCacheEntry AD013_MatchCache[AD013_MATCH_CACHE_SLOTS] = { { 0x00 } };
+
+// Match Score Statistics
+static AD013_ScoreStats AD013_Scores = { { 0x00 } };
+
+// SimHash Accumulator (fed packet by packet)
+typedef struct simhash_st {
+  int16_t bits[32];
+  int     prev;     /* Last byte of the previous packet (-1: none) */
+} AD013_SimHashCtx;
+
+// Link found by the last full handshake (see AD013_FindSensorWarm)
+typedef struct session_st {
+  uint32_t magic;
+  long     baud;      /* Port Speed (0: port used as-is) */
+  char     devId[4];  /* Device Address reported by the sensor */
+  uint16_t sum;       /* Over the fields above */
+} AD013_Session;
+
+// Not cleared at startup (garbage after a power-on)
+static AD013_Session AD013_WarmSession AD013_NOINIT;
+
+// Power States
+#define AD013_POWER_AWAKE          0
+#define AD013_POWER_ASLEEP         1
+#define AD013_POWER_WAKING         2
+
+// Power Manager State
+typedef struct power_state_st {
+  unsigned long    idleTimeout;  /* ms idle before sleeping (0: never) */
+  unsigned long    lastActive;   /* millis() of the last command */
+  unsigned long    sleepStart;   /* millis() when the module went to sleep */
+  uint8_t          state;
+  volatile uint8_t touched;      /* Set by AD013_PowerTouch() */
+  bool             verified;     /* auth holds a verified handshake */
+  AD013_Params     auth;         /* Last successful PS_VerifyPwd */
+  AD013_PowerStats stats;
+} AD013_PowerState;
+
+static AD013_PowerState AD013_Power = { AD013_POWER_IDLE_TIMEOUT };
+
 // Global Variable(s)
 static const char msgTemplate[10] = {
   0xEF, 0x01,             /* Header */
@@ -114,13 +145,57 @@ int AD013_AddParam1(AD013_Params * params, uint8_t val);
 int AD013_AddParam2(AD013_Params * params, uint16_t val);
 int AD013_AddParamN(AD013_Params * params, char * buff, uint8_t size);
 
+int AD013_SetPortSpeed(AD013_BaudControl * baudCtl, long speed);
+int AD013_VerifyPassword(Stream & SensorCom, AD013_Params * params);
+int AD013_WriteReg(Stream & SensorCom, int reg, int val);
+int AD013_SimHashSink(const byte * data, int data_len, void * ctx);
+uint32_t AD013_SimHashFinal(const AD013_SimHashCtx * ctx);
+long AD013_CharHashUpload(Stream & SensorCom, int bufferId, uint32_t * hash);
+int AD013_MatchCacheConfirm(Stream & SensorCom, int templateId, int * score);
+int AD013_ReadBytes(Stream & SensorCom, char * buff, int len, unsigned long deadline);
+int AD013_ReadSum(Stream & SensorCom, byte * buff, int len, unsigned long deadline, uint16_t * sum);
+void AD013_RecvFlush(Stream & SensorCom);
+int AD013_EnrollCapture(Stream & SensorCom, bool lift);
+int AD013_EnrollLookup(Stream & SensorCom, const byte * bitmap, int bitmap_len, int * templateId);
+int AD013_PowerWakeBy(Stream & SensorCom, unsigned long deadline);
+int AD013_ReadSysParamsFor(Stream & SensorCom, AD013_SysParams * sysParams, unsigned long timeout);
+int AD013_PacketSizeUse(Stream & SensorCom, int size);
+uint16_t AD013_SessionSum(const AD013_Session * session);
+bool AD013_SessionValid(void);
+void AD013_SessionSave(long baud, const char * devId);
+unsigned long AD013_SearchTimeout(bool bounded, unsigned long limit);
+int AD013_SearchRun(Stream & SensorCom, int timeOut, bool bounded, unsigned long limit,
+                    int threashold, bool SecurityOfficerOnly, AD013_SearchResult * result);
+
+int AD013_BuildCmd(char * buff, int code, AD013_Params * params);
+
 int AD013_Send (int           code,
               Stream     &  SensorCom,
               AD013_Params *  params             = NULL,
               byte       ** recv_data_buff     = NULL,
-              int        *  recv_data_buff_len = NULL);
+              int        *  recv_data_buff_len = NULL,
+              unsigned long timeout            = AD013_DEF_TIMEOUT);
               
-int AD013_Recv(char * data, int data_len);
+long AD013_SendData(Stream     & SensorCom,
+                    const byte * buff,
+                    long         buff_len);
+
+long AD013_SendPacket(Stream     & SensorCom,
+                      const byte * buff,
+                      long         buff_len,
+                      int          packetSize);
+
+long AD013_RecvData(Stream       & SensorCom,
+                    byte         * buff,
+                    long           buff_len,
+                    AD013_DataSink sink,
+                    void         * ctx);
+
+long AD013_RecvDataRing(AD013_RingStream * ringCom,
+                        byte             * buff,
+                        long               buff_len,
+                        AD013_DataSink     sink,
+                        void             * ctx);
 
 #define AD013_ClearParams(a) \
   (a)->size = 0
@@ -128,6 +203,12 @@ int AD013_Recv(char * data, int data_len);
 #define PS_VerifyPwd(a,b) \
   AD013_Send(0x13,a,b)
 
+#define PS_WriteReg(a,b) \
+  AD013_Send(0x0E,a,b)
+
+#define PS_ReadSysPara(a,b,c) \
+  AD013_Send(0x0F,a,NULL,b,c)
+
 #define PS_GetImage(a) \
   AD013_Send(0x01,a)
 
@@ -137,6 +218,39 @@ int AD013_Recv(char * data, int data_len);
 #define PS_Search(a,b,c,d) \
   AD013_Send(0x04,a,b,c,d)
 
+#define PS_RegModel(a) \
+  AD013_Send(0x05,a)
+
+#define PS_StoreChar(a,b) \
+  AD013_Send(0x06,a,b)
+
+#define PS_LoadChar(a,b) \
+  AD013_Send(0x07,a,b)
+
+#define PS_Match(a,b,c) \
+  AD013_Send(0x03,a,NULL,b,c)
+
+#define PS_UpChar(a,b) \
+  AD013_Send(0x08,a,b)
+
+#define PS_DownChar(a,b) \
+  AD013_Send(0x09,a,b)
+
+#define PS_UpImage(a) \
+  AD013_Send(0x0A,a)
+
+#define PS_DeletChar(a,b) \
+  AD013_Send(0x0C,a,b)
+
+#define PS_ReadIndexTable(a,b,c,d) \
+  AD013_Send(0x1F,a,b,c,d)
+
+#define PS_Sleep(a) \
+  AD013_Send(0x33,a)
+
+#define PS_ControlBLN(a,b) \
+  AD013_Send(0x3C,a,b)
+
                         // =============================
                         // Fingerprint Utility Functions
                         // =============================
@@ -204,24 +318,214 @@ int AD013_AddParamN(AD013_Params * params, char * buff, uint8_t size) {
    return params->size;
 }
 
-int AD013_Send (int           code,
-              Stream     &  Sensorcom, 
-              AD013_Params *  params,
-              byte       ** recv_data_buff,
-              int        *  recv_data_buff_len) {
+#if defined(AD013_HOST_BUILD) && defined(__SSE2__)
 
-  // Receive Buffer
-  char     recv_buff[20] = { 0x00 };
-  uint16_t recv_buff_len = 0;
-  int      recv_code     = -1;
+// Adds the bytes of a 16-byte block to the two 64-bit lanes of acc
+#define AD013_SUM_BLOCK(acc, blk) \
+  acc = _mm_add_epi64(acc, _mm_sad_epu8(blk, _mm_setzero_si128()))
+
+// Folds the lanes of acc into a 16-bit sum
+#define AD013_SUM_FOLD(sum, acc) \
+  sum += (uint16_t)(_mm_cvtsi128_si32(acc) + \
+                    _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc)))
 
-  int read_chars = 0;
+uint16_t AD013_Sum(uint16_t sum, const byte * data, int data_len) {
+
+  __m128i acc = _mm_setzero_si128();
   int i = 0;
-  
+
+  // 16 bytes at a time (PSADBW sums 8 bytes per lane)
+  for (; i + 16 <= data_len; i += 16) {
+    AD013_SUM_BLOCK(acc, _mm_loadu_si128((const __m128i *)(data + i)));
+  }
+  AD013_SUM_FOLD(sum, acc);
+
+  for (; i < data_len; i++) sum += data[i];
+
+  return sum;
+}
+
+uint16_t AD013_CopySum(uint16_t sum, byte * dst, const byte * src, int len) {
+
+  __m128i acc = _mm_setzero_si128();
+  __m128i blk;
+  int i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    blk = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_si128((__m128i *)(dst + i), blk);
+    AD013_SUM_BLOCK(acc, blk);
+  }
+  AD013_SUM_FOLD(sum, acc);
+
+  for (; i < len; i++) sum += (dst[i] = src[i]);
+
+  return sum;
+}
+
+#elif defined(AD013_HOST_BUILD)
+
+// Sums the bytes of a 64-bit word into four 16-bit lanes
+#define AD013_SUM_WORD(w) \
+  (((w) & 0x00FF00FF00FF00FFULL) + (((w) >> 8) & 0x00FF00FF00FF00FFULL))
+
+// Words that can be added before a lane overflows (510 per word)
+#define AD013_SUM_MAX_WORDS      128
+
+// Folds the four lanes of acc into a 16-bit sum
+#define AD013_SUM_FOLD(sum, acc) \
+  sum += (uint16_t)((acc) + ((acc) >> 16) + ((acc) >> 32) + ((acc) >> 48))
+
+uint16_t AD013_Sum(uint16_t sum, const byte * data, int data_len) {
+
+  uint64_t acc = 0;
+  uint64_t w = 0;
+  int i = 0;
+  int n = 0;
+
+  // 8 bytes at a time
+  while (i + 8 <= data_len) {
+    acc = 0;
+    for (n = 0; n < AD013_SUM_MAX_WORDS && i + 8 <= data_len; n++, i += 8) {
+      memcpy(&w, data + i, sizeof(w));
+      acc += AD013_SUM_WORD(w);
+    }
+    AD013_SUM_FOLD(sum, acc);
+  }
+
+  for (; i < data_len; i++) sum += data[i];
+
+  return sum;
+}
+
+uint16_t AD013_CopySum(uint16_t sum, byte * dst, const byte * src, int len) {
+
+  uint64_t acc = 0;
+  uint64_t w = 0;
+  int i = 0;
+  int n = 0;
+
+  while (i + 8 <= len) {
+    acc = 0;
+    for (n = 0; n < AD013_SUM_MAX_WORDS && i + 8 <= len; n++, i += 8) {
+      memcpy(&w, src + i, sizeof(w));
+      memcpy(dst + i, &w, sizeof(w));
+      acc += AD013_SUM_WORD(w);
+    }
+    AD013_SUM_FOLD(sum, acc);
+  }
+
+  for (; i < len; i++) sum += (dst[i] = src[i]);
+
+  return sum;
+}
+
+#else
+
+uint16_t AD013_Sum(uint16_t sum, const byte * data, int data_len) {
+
+  const byte * end = data + data_len;
+
+  // 16-bit Additive Checksum (overflow is discarded), unrolled
+  // to save the loop overhead on 8-bit MCUs
+  while (end - data >= 4) {
+    sum += data[0];
+    sum += data[1];
+    sum += data[2];
+    sum += data[3];
+    data += 4;
+  }
+
+  while (data < end) sum += *data++;
+
+  return sum;
+}
+
+uint16_t AD013_CopySum(uint16_t sum, byte * dst, const byte * src, int len) {
+
+  const byte * end = src + len;
+
+  while (end - src >= 4) {
+    sum += (dst[0] = src[0]);
+    sum += (dst[1] = src[1]);
+    sum += (dst[2] = src[2]);
+    sum += (dst[3] = src[3]);
+    src += 4;
+    dst += 4;
+  }
+
+  while (src < end) sum += (*dst++ = *src++);
+
+  return sum;
+}
+
+#endif
+
+int AD013_ReadBytes(Stream & SensorCom, char * buff, int len, unsigned long deadline) {
+
+  int avail = 0;
+  int buff_len = 0;
+
+  // Reads exactly len bytes (unless the deadline is reached). Only
+  // the bytes already received are read, so the Stream's own timeout
+  // never adds to the deadline
+  while (buff_len < len) {
+    if ((avail = SensorCom.available()) > 0) {
+      if (avail > len - buff_len) avail = len - buff_len;
+      buff_len += SensorCom.readBytes(buff + buff_len, avail);
+    } else if (AD013_DeadlinePassed(deadline)) {
+      break;
+    } else {
+      yield();
+    }
+  }
+
+  return buff_len;
+}
+
+int AD013_ReadSum(Stream & SensorCom, byte * buff, int len, unsigned long deadline, uint16_t * sum) {
+
+  byte block[AD013_READ_BLOCK_SIZE];
+  int buff_len = 0;
+  int block_len = 0;
+  int read_len = 0;
+
+  // Same as AD013_ReadBytes(), the bytes go through a small block
+  // that is still hot when it is copied and summed in one pass
+  while (buff_len < len) {
+    block_len = len - buff_len;
+    if (block_len > (int) sizeof(block)) block_len = sizeof(block);
+    read_len = AD013_ReadBytes(SensorCom, (char *) block, block_len, deadline);
+    *sum = AD013_CopySum(*sum, buff + buff_len, block, read_len);
+    buff_len += read_len;
+    if (read_len < block_len) break;
+  }
+
+  return buff_len;
+}
+
+void AD013_RecvFlush(Stream & SensorCom) {
+
+  unsigned long quiet = AD013_DeadlineIn(AD013_RECV_QUIET_MS);
+
+  // Once the packet framing is lost the rest of the transfer cannot
+  // be skipped packet by packet: the bytes are discarded until the
+  // line stays idle, so that the next command reads its own ACK
+  while (!AD013_DeadlinePassed(quiet)) {
+    if (SensorCom.available() > 0) {
+      SensorCom.read();
+      quiet = AD013_DeadlineIn(AD013_RECV_QUIET_MS);
+    } else {
+      yield();
+    }
+  }
+}
+
+int AD013_BuildCmd(char * send_buff, int code, AD013_Params * params) {
+
   uint16_t len = 0;
   uint16_t sum = 0;
-  uint16_t max_retries = 5;
-  
+
   // Small Checks
   if ((params != NULL) && (params->buff == NULL || params->size < 1))
     return -1;
@@ -229,9 +533,6 @@ int AD013_Send (int           code,
   // Send Buffer Size
   int send_buff_len = 12 + (params != NULL ? params->size : 0);
 
-  // Allocates the needed Memory
-  char * send_buff = (char *) malloc(send_buff_len);
-
   // Sets the Defaults
   memcpy(send_buff, msgTemplate, sizeof(msgTemplate));
 
@@ -250,32 +551,79 @@ int AD013_Send (int           code,
   AD013_set_uint16_value(send_buff + AD013_MSG_OFFSET_LENGTH, len);
 
   // Calculates the Checksum
-  for (i = AD013_MSG_OFFSET_FLAG; i < send_buff_len - 2; i++) {
-    // Calculates the Sum
-    sum = (sum + (uint8_t) send_buff[i]) & 65535;
-  }
+  sum = AD013_Sum(0, (byte *) send_buff + AD013_MSG_OFFSET_FLAG,
+                  send_buff_len - 2 - AD013_MSG_OFFSET_FLAG);
 
   // Saves the Sum
   AD013_set_uint16_value(&send_buff[AD013_MSG_OFFSET_DATA + (params != NULL ? params->size : 0)], sum);
 
-  // printf("SENT SUM: %02X\n", 
-  //   AD013_get_uint16_value(send_buff + send_buff_len - 2););
-  
+  return send_buff_len;
+}
+
+int AD013_SendCmd(Print        & SensorCom,
+                  int            code,
+                  AD013_Params * params) {
+
+  char send_buff[AD013_MAX_CMD_SIZE];
+  int send_buff_len = 0;
+
+  if ((send_buff_len = AD013_BuildCmd(send_buff, code, params)) < 0) return -1;
+
+  // Writes the Command, the reply is not waited for
+  SensorCom.write((byte *)send_buff, send_buff_len);
+
+  return send_buff_len;
+}
+
+int AD013_Send (int           code,
+              Stream     &  SensorCom, 
+              AD013_Params *  params,
+              byte       ** recv_data_buff,
+              int        *  recv_data_buff_len,
+              unsigned long timeout) {
+
+  // Send Buffer
+  char     send_buff[AD013_MAX_CMD_SIZE];
+  int      send_buff_len = 0;
+
+  // Receive Buffer
+  char     recv_buff[AD013_MAX_ACK_BUFF_SIZE] = { 0x00 };
+  uint16_t recv_buff_len = 0;
+  int      recv_code     = -1;
+
+  uint16_t ack_len = 0;
+  unsigned long deadline = 0;
+
+  // Any command wakes the module up first (but Sleep)
+  if (AD013_Power.state == AD013_POWER_ASLEEP && code != 0x33) {
+    if (AD013_PowerWake(SensorCom) < 0) return -1;
+  }
+
+  if ((send_buff_len = AD013_BuildCmd(send_buff, code, params)) < 0)
+    return -1;
+
   // Writes the Fixed header
   SensorCom.write((byte *)send_buff, send_buff_len);
 
+  // The whole ACK must arrive before the deadline
+  deadline = AD013_DeadlineIn(timeout);
+
   // Now we need to read the ACK packet. First we get the
-  // fixed size of the packet;
-  while (recv_buff_len < AD013_MSG_HEADER_SIZE + 2) {
-    if (0 >= --max_retries) break;
-    // while (SensorCom.available() == false)
-    //  delay(1); //Wait for user input
-    read_chars = SensorCom.readBytes(recv_buff + recv_buff_len, sizeof(recv_buff) - recv_buff_len);
-    recv_buff_len += read_chars; 
+  // fixed size part of the packet (up to the Length)
+  recv_buff_len = AD013_ReadBytes(SensorCom, recv_buff, AD013_MSG_OFFSET_CODE, deadline);
+
+  if (recv_buff_len == AD013_MSG_OFFSET_CODE) {
+    // Then exactly the announced Code/Data + Sum, so that the
+    // data packets following the ACK (if any) are left on the
+    // Stream for AD013_RecvData()
+    ack_len = AD013_get_uint16_value(recv_buff + AD013_MSG_OFFSET_LENGTH);
+    if (ack_len >= 3 && ack_len <= sizeof(recv_buff) - AD013_MSG_OFFSET_CODE) {
+      recv_buff_len += AD013_ReadBytes(SensorCom, recv_buff + recv_buff_len, ack_len, deadline);
+    }
   }
 
-  if (recv_buff_len < 10) {
-    printf("ERROR: Cannot Read (Timeout Reached; Read: %d bytes Reply)\n", recv_buff_len);
+  if (recv_buff_len < AD013_MSG_HEADER_SIZE + 2) {
+    AD013_LOG_ERROR("Cannot Read (Timeout Reached; Read: %d bytes Reply)", recv_buff_len);
     goto err;
   }
 
@@ -297,281 +645,1950 @@ int AD013_Send (int           code,
     recv_code = (uint8_t) *(recv_buff + AD013_MSG_OFFSET_CODE);
     
     // Calculates the Sum
-    for (i = AD013_MSG_OFFSET_FLAG ; i < recv_buff_len - 2; i++) {
-      sum = (sum + recv_buff[i]) & 65535;
-    }
+    sum = AD013_Sum(0, (byte *) recv_buff + AD013_MSG_OFFSET_FLAG,
+                    recv_buff_len - 2 - AD013_MSG_OFFSET_FLAG);
 
     // Compares the Checksums, if an error, let's reject
     // the message and return the error
     if (sum != recv_sum) {
-      printf("CHECKSUM ERROR: Received = %02X, Calculated = %02\n", 
-        recv_sum, sum);
-      if (send_buff) free(send_buff);
+      AD013_LOG_ERROR("Checksum: Received = %04X, Calculated = %04X", recv_sum, sum);
       return -99;
     }
 
-    // Here we should get the parameters
+    // Here we should get the parameters (Length includes
+    // the Code and the Sum)
     if (recv_data_buff) {
+      max_data = pkt_len - 3;
       // If the pointer is provided
       if (*recv_data_buff == NULL) {
         // If the Buffer is not Provided, we allocate it
-        max_data = pkt_len - 2;
-        *recv_data_buff = (byte *) malloc (pkt_len - 2);
-      } else {
+        *recv_data_buff = (byte *) malloc (max_data > 0 ? max_data : 1);
+      } else if (recv_data_buff_len && *recv_data_buff_len < max_data) {
         // Gets the size of the input buffer (if provided)
         max_data = *recv_data_buff_len;
       }
       // We have a good buffer, now let's fill it in
       memcpy(*recv_data_buff, &recv_buff[AD013_MSG_OFFSET_DATA], max_data);
+      if (recv_data_buff_len) *recv_data_buff_len = max_data;
     }
     
   } else {
-    if (AD013_DEBUG_IS_ENABLED) printf("ERROR: Received checksum does not match.\n");
+    AD013_LOG_ERROR("Unexpected Reply Header");
     goto err;
   }
-  
-  if (send_buff) free(send_buff);
+
+  // Restarts the idle period
+  AD013_Power.lastActive = millis();
   
   return recv_code;
 
 err:
 
   // Debug Information
-  printf("MSG SENT: ");
-  for (i = 0 ; i < send_buff_len; i++) {
-    printf("%02.2X:", send_buff[i]);
-  }
-  Serial.println();
-  delay(50);
-  
-  printf("MSG RECV: ");
-  for (i = 0; i < recv_buff_len; i++) {
-    printf("%02.2X:", recv_buff[i]);
-  }
-  Serial.println();
-  delay(50);
-
-  // Free Allocated Memory
-  if (send_buff) free(send_buff);
+  AD013_LOG_DEBUG("MSG SENT: Code %02X (%d bytes)", code, send_buff_len);
+  AD013_LOG_DEBUG("MSG RECV: %d bytes, Flag %02X, Code %02X", recv_buff_len,
+    (uint8_t) recv_buff[AD013_MSG_OFFSET_FLAG], (uint8_t) recv_buff[AD013_MSG_OFFSET_CODE]);
 
   // Error
   return -1;
 }
 
-int AD013_Recv(char * data, int data_len) {
+long AD013_SendData(Stream     & SensorCom,
+                    const byte * buff,
+                    long         buff_len) {
 
-  char buff[128];
-  
-  int read_chars = 0;
-  int i = 0;
-  
-  read_chars = SensorCom.readBytes(buff, sizeof(buff));
+  long total = 0;
+  long sent = 0;
 
-  return 1;
+  if (!buff || buff_len <= 0) return -1;
+
+  while (total < buff_len) {
+    if ((sent = AD013_SendPacket(SensorCom, buff + total, buff_len - total, AD013_PacketSize)) <= 0) return -1;
+    total += sent;
+  }
+
+  return total;
 }
 
-                        // ================================
-                        // Fingerprint High-Level Functions
-                        // ================================
+long AD013_SendPacket(Stream     & SensorCom,
+                      const byte * buff,
+                      long         buff_len,
+                      int          packetSize) {
 
-int CFP_FindSensor(Stream     & SensorCom,
-                   int          serSpeed,
-                   AD013_Params * params) {
-  // Let's Check we have a sensor attached and we can
-  // verify the password. Use the params to modify the
-  // defaults
-  
-  AD013_Params myParams;
-    // Container for params
+  // Packet Header (Header, DevId, Flag, Length)
+  char hdr[AD013_MSG_OFFSET_CODE];
+  char sum_buff[2];
 
-  SoftwareSerial * swSerial = (SoftwareSerial *) &SensorCom;
-    // Container for a more generic Serial interface
-    
-  if (!params) {
-    myParams = AD013_DefaultParams;
-    // Adds the Password as the default command
-    AD013_AddParamN(&myParams, AD013_def_passwd, sizeof(AD013_def_passwd));
-  } else {
-    // Copies the params struct into the local variable
-    myParams = *params;
-  }
+  int data_len = 0;
+  uint16_t sum = 0;
 
-  // Sets the Default Timeout
-  SensorCom.setTimeout(defTimeout);
+  if (!buff || buff_len <= 0) return -1;
 
-  if (serSpeed < 0) {
-    // Array Of Speeds To Try
-    int speedVals[5] = {115200, 57600, 38400, 19200, 9600};
-    // Debug Info
-    if (AD013_DEBUG_IS_ENABLED)
-      printf("Looking for Fingerprint Sensor - checking 115200-9600 baud range\n");
- 
-    // Check which Speed Works
-    for (int i = 0; i < sizeof(speedVals)/sizeof(int); i++) {
-      if (AD013_DEBUG_IS_ENABLED) printf("Checking Speed %d baud ....: ", speedVals[i]);
-      // SensorCom.begin(speedVals[i]);
-      swSerial->begin(speedVals[i]);
-      delay(100);
-      if (AD013_Send(0x13, SensorCom, &myParams) < 0) {
-        if (AD013_DEBUG_IS_ENABLED) printf("Not Supported\n");
-      } else {
-        if (AD013_DEBUG_IS_ENABLED) printf("Ok (Supported).\n");
-        return 1;
-      }
-    }
-    
-    // Debug
-    if (AD013_DEBUG_IS_ENABLED)
-      printf("All Speed Failed, Aborting.\n");
+  memcpy(hdr, msgTemplate, sizeof(hdr));
 
-    // ALL speeds fail, let's fail
-    return -1;
-    
-  } else {
+  // Payload of the packet (up to the sensor's packet size)
+  data_len = buff_len > packetSize ? packetSize : buff_len;
 
-    // If Speed was requested, let's set the speed
-    if (serSpeed > 0) swSerial->begin(serSpeed);
-    delay(50);
-  
-    // Execute the call
-    if (AD013_Send(0x13, SensorCom, &myParams) < 0) return -1;
-  }
-  
-  // All Done
-  return 1;
+  // Last packet is flagged as such
+  hdr[AD013_MSG_OFFSET_FLAG] = (data_len < buff_len ?
+    AD013_PKT_FLAG_DATA : AD013_PKT_FLAG_DATA_END);
+  AD013_set_uint16_value(hdr + AD013_MSG_OFFSET_LENGTH, data_len + 2);
+
+  sum = AD013_Sum(0, (byte *) hdr + AD013_MSG_OFFSET_FLAG,
+                  sizeof(hdr) - AD013_MSG_OFFSET_FLAG);
+  sum = AD013_Sum(sum, buff, data_len);
+  AD013_set_uint16_value(sum_buff, sum);
+
+  // The payload is written straight from the caller's buffer
+  SensorCom.write((byte *) hdr, sizeof(hdr));
+  SensorCom.write(buff, data_len);
+  SensorCom.write((byte *) sum_buff, sizeof(sum_buff));
+
+  return data_len;
 }
 
-int AD013_SearchTemplate (Stream & SensorCom,
-                        int      timeOut,
-                        int      threashold,
-                        bool     SecurityOfficerOnly) {
+long AD013_RecvData(Stream       & SensorCom,
+                    byte         * buff,
+                    long           buff_len,
+                    AD013_DataSink sink,
+                    void         * ctx) {
 
-  int defDelayPeriod = 240; // Built-in Delay for processing
-  int delayPeriod = 120;
-  int code = -1;
+  // Packet Header (Header, DevId, Flag, Length)
+  char hdr[AD013_MSG_OFFSET_CODE];
+  char recv_sum[2];
 
-  // Allocates the params and initializes w/ default values
-  AD013_Params params = AD013_DefaultParams;
+  // Staging Buffer (sink, or draining after an error)
+  byte chunk[AD013_MAX_BIN_BUFF_SIZE];
 
-  // Debug Information
-  if (AD013_DEBUG_IS_ENABLED)
-    printf("Please put finger on sensor...\n");
+  byte * data = NULL;
+  long total = 0;
+  int data_len = 0;
+  int ret = 1;
+  uint8_t flag = 0;
+  uint16_t sum = 0;
+  unsigned long deadline = 0;
 
-  // Generates the Char/Template to Serch for
-  while ((code = PS_GetImage(SensorCom)) != 0) {
+  AD013_RingStream * ringCom = NULL;
 
-    // Checks for specific errors
-    if (code == 0x01 || code == 0x03) {
-      // Packet Error (0x01) or Failure (0x03)
-      if (AD013_DEBUG_IS_ENABLED)
-        printf("ERROR: Cannot Get Image (code: %d)\n", code);
-    }
+  // Over a receive ring, the packets are not read out of the Stream
+  if ((ringCom = AD013_RingStreamOf(SensorCom)) != NULL)
+    return AD013_RecvDataRing(ringCom, buff, buff_len, sink, ctx);
 
-    // Code 0x02 is for Fingerprint NOT on sensor (polling)
-    
-    // Checks for Timeout Conditions
-    if (timeOut <= 0) {
-      if (AD013_DEBUG_IS_ENABLED) printf("Timeout Reached, aborting...\n");
-      break;
-    } else {
-      delay(delayPeriod);
-      timeOut -= delayPeriod + defDelayPeriod;
+  do {
+
+    // Each packet must arrive before its own deadline
+    deadline = AD013_DeadlineIn(AD013_DEF_TIMEOUT);
+
+    // Reads the fixed part of the data packet
+    if (AD013_ReadBytes(SensorCom, hdr, sizeof(hdr), deadline) < (int) sizeof(hdr)) {
+      AD013_LOG_ERROR("Cannot Read Data Packet (Timeout Reached)");
+      AD013_RecvFlush(SensorCom);
+      return -1;
     }
-  }
 
-  // If we do not have a successful finger on
-  // the sensor, let's abort
-  if (code != 0) return (-1);
+    // Checks the Header and the Packet Identifier
+    flag = (uint8_t) hdr[AD013_MSG_OFFSET_FLAG];
+    if (memcmp(hdr, msgTemplate, AD013_MSG_OFFSET_DEVID) != 0 ||
+        (flag != AD013_PKT_FLAG_DATA && flag != AD013_PKT_FLAG_DATA_END)) {
+      AD013_LOG_ERROR("Unexpected Packet (Flag: %02X)", flag);
+      AD013_RecvFlush(SensorCom);
+      return -1;
+    }
 
-  // DEBUG information
-  if (AD013_DEBUG_IS_ENABLED)
-    printf("Preparing to Match Finger...\n");
+    // Payload Size (Length includes the Sum)
+    data_len = AD013_get_uint16_value(hdr + AD013_MSG_OFFSET_LENGTH) - 2;
+    if (data_len < 0) {
+      AD013_RecvFlush(SensorCom);
+      return -1;
+    }
 
-  // Adds the number of the buffer to match (1)
-  AD013_AddParam1(&params, 1);
+    // Reads the Payload in place (caller's buffer) or into the
+    // staging buffer for the sink. Once the transfer failed, we
+    // only drain the remaining packets
+    if (buff && ret > 0) {
+      if (total + data_len > buff_len) {
+        AD013_LOG_ERROR("Buffer too small (%ld bytes)", buff_len);
+        ret = -1;
+      }
+    }
+    data = (buff && ret > 0) ? buff + total : chunk;
+    if (data == chunk && data_len > (int) sizeof(chunk)) {
+      AD013_LOG_ERROR("Data Packet too large (%d bytes)", data_len);
+      AD013_RecvFlush(SensorCom);
+      return -1;
+    }
 
-  // Generates the Char/Template from the acquired
-  // Image. Possible error codes are handled in the
-  // switch statement
-  code = PS_GenChar(SensorCom, &params);
-
-  // Error Handling
-  switch (code) {
-    case AD013_CODE_ERROR                  /* 0x01 */ :
-    case AD013_CODE_FEATURE_FAIL_AMORPHOUS /* 0x06 */ :
-    case AD013_CODE_FEATURE_FAIL_MINUTIAE  /* 0x07 */ :
-    case AD013_CODE_IMAGE_INCOMPLETE_ERROR /* 0x15 */ : {
-      if (AD013_DEBUG_IS_ENABLED) 
-        printf("DETECTED CFS ERROR [%d]\n", code);
+    // The Payload is summed while it is copied in
+    sum = AD013_Sum(0, (byte *) hdr + AD013_MSG_OFFSET_FLAG,
+                    sizeof(hdr) - AD013_MSG_OFFSET_FLAG);
+    if (AD013_ReadSum(SensorCom, data, data_len, deadline, &sum) < data_len ||
+        AD013_ReadBytes(SensorCom, recv_sum, sizeof(recv_sum), deadline) < (int) sizeof(recv_sum)) {
+      AD013_LOG_ERROR("Cannot Read Data Packet (Timeout Reached)");
+      AD013_RecvFlush(SensorCom);
       return -1;
-    } break;
+    }
 
-    default:
-      if (AD013_DEBUG_IS_ENABLED) printf("CFS CODE: %d\n", code);
-  }
+    // Compares the Checksums
+    if (sum != AD013_get_uint16_value(recv_sum)) {
+      AD013_LOG_ERROR("Checksum: Received = %04X, Calculated = %04X",
+        AD013_get_uint16_value(recv_sum), sum);
+      if (ret > 0) ret = -99;
+    }
 
-  // Builds the new params
-  AD013_ClearParams(&params);  // Clears the Parameters
-  AD013_AddParam1(&params, 1); // Adds Buffer Num. Param (1 byte)
-  AD013_AddParam2(&params, 0); // Adds Start Num. Param (2 bytes)
-  AD013_AddParam2(&params, 99);// Adds End Num. Param (2 bytes)
-  
-  // Search the DB for the Generated Char
-  // byte data[20] = { 0x00 };
-  byte * data = NULL;
-  int len = 0;
-  int matched_template = PS_Search(SensorCom, &params, (byte **) &data, &len);
+    // Hands the Packet to the sink
+    if (ret > 0 && !buff && sink) {
+      if (sink(data, data_len, ctx) < 0) ret = -1;
+    }
 
-  if (matched_template >= 0) {
-    if (AD013_DEBUG_IS_ENABLED)
-      printf("Matched Template: %d (Template: %d, Score: %d)\n",
-        matched_template, AD013_get_uint16_value((char *)data), 
-        AD013_get_uint16_value((char *)&data[2]));
-  } else {
-    printf("ERROR: Code %d\n");
-  }
+    if (ret > 0) total += data_len;
 
-  if (data) free(data);
+  } while (flag != AD013_PKT_FLAG_DATA_END);
 
-  return 1;
+  return ret > 0 ? total : ret;
 }
 
-/* !\brief Clears one template from the fingerprint DB */
+long AD013_RecvDataRing(AD013_RingStream * ringCom,
+                        byte             * buff,
+                        long               buff_len,
+                        AD013_DataSink     sink,
+                        void             * ctx) {
+
+  AD013_Parser * parser = ringCom->parser();
+  AD013_FrameView view;
+
+  long total = 0;
+  int ret = 1;
+  uint8_t flag = 0;
+  uint16_t errors = 0;
+  unsigned long deadline = 0;
+
+  do {
+
+    // Each packet must arrive before its own deadline
+    deadline = AD013_DeadlineIn(AD013_DEF_TIMEOUT);
+    errors = parser->errors;
+
+    // The packet is validated (length and checksum) where it was
+    // received, only a packet wrapping the end of the ring is copied
+    while (!AD013_ParserPeek(parser, ringCom->ring(), &view)) {
+      if (AD013_DeadlinePassed(deadline)) {
+        AD013_LOG_ERROR("Cannot Read Data Packet (Timeout Reached)");
+        AD013_RecvFlush(*ringCom);
+        return -1;
+      }
+      yield();
+    }
 
-int AD013_ClearTemplates (Stream & SerialPort,
-					    int      rangeStart,
-					    int      rangeEnd) {
-  // DEBUG: PLACEHOLDER: Missing Code
-  printf("AD013_ClearTemplate() Not Implemented, yet.\n");
-  return -1;
-}
+    // Packets dropped by the parser (checksum, length) are lost
+    // for the transfer, the rest is still drained
+    if (parser->errors != errors) {
+      AD013_LOG_ERROR("Bad Data Packets Dropped (%d)", parser->errors - errors);
+      if (ret > 0) ret = -99;
+    }
 
-                      
-/* !\brief Clears all user templates from the fingerprint DB */
+    // Checks the Header and the Packet Identifier
+    flag = view.flag;
+    if (memcmp(view.data - AD013_MSG_OFFSET_CODE, msgTemplate, AD013_MSG_OFFSET_DEVID) != 0 ||
+        (flag != AD013_PKT_FLAG_DATA && flag != AD013_PKT_FLAG_DATA_END)) {
+      AD013_LOG_ERROR("Unexpected Packet (Flag: %02X)", flag);
+      AD013_ParserRelease(parser, ringCom->ring(), &view);
+      AD013_RecvFlush(*ringCom);
+      return -1;
+    }
 
-int AD013_ClearUserTemplates (Stream & SerialPort) {
-  // DEBUG: PLACEHOLDER: Missing Code
-  printf("AD013_ClearUserTemplates() Not Implemented, yet.\n");
-  return -1;
-}
+    // The Payload goes from the ring to the caller's buffer, or
+    // straight to the sink
+    if (buff && ret > 0) {
+      if (total + view.len > buff_len) {
+        AD013_LOG_ERROR("Buffer too small (%ld bytes)", buff_len);
+        ret = -1;
+      } else {
+        memcpy(buff + total, view.data, view.len);
+      }
+    } else if (ret > 0 && sink) {
+      if (sink(view.data, view.len, ctx) < 0) ret = -1;
+    }
 
+    if (ret > 0) total += view.len;
 
-/* !\brief Clears all the Security Officer (SO) templates from the
-           fingerprint DB */
+    AD013_ParserRelease(parser, ringCom->ring(), &view);
 
-int AD013_ClearSOTemplates(Stream * SerialPort) {
-  {
-  // DEBUG: PLACEHOLDER: Missing Code
-  printf("AD013_ClearSOTemplates() Not Implemented, yet.\n");
-  return -1;
+  } while (flag != AD013_PKT_FLAG_DATA_END);
+
+  return ret > 0 ? total : ret;
 }
+
+                        // ================================
+                        // Fingerprint High-Level Functions
+                        // ================================
+
+int AD013_SetPortSpeed(AD013_BaudControl * baudCtl, long speed) {
+
+  // Without a Baud Control the port speed is fixed
+  if (!baudCtl || !baudCtl->begin) return -1;
+
+  return baudCtl->begin(baudCtl->port, speed);
 }
 
-/* !\brief Enrolls a new Finger into the Sensor's DB */
+                        // =====================
+                        // Baud Control Backends
+                        // =====================
 
-int AD013_Enroll(Stream & SerialPort, bool isSecurityOfficer) {
+#ifndef AD013_HOST_BUILD
+int AD013_HardwareSerialBegin(void * port, long baud) {
 
-	// DEBUG: PLACEHOLDER: MISSING CODE
-	if (AD013_DEBUG_IS_ENABLED) printf("AD013_Enroll() Not Implemented, yet.\n");
-	return -1;
+  HardwareSerial * hwSerial = (HardwareSerial *) port;
+
+  hwSerial->flush();
+  hwSerial->end();
+  hwSerial->begin(baud);
+
+  return 1;
+}
+
+AD013_BaudControl AD013_HardwareSerialBaud(HardwareSerial & port) {
+
+  AD013_BaudControl baudCtl = { AD013_HardwareSerialBegin, &port };
+  return baudCtl;
+}
+#endif
+
+#ifdef AD013_HAS_SOFTWARE_SERIAL
+int AD013_SoftwareSerialBegin(void * port, long baud) {
+
+  SoftwareSerial * swSerial = (SoftwareSerial *) port;
+
+  swSerial->end();
+  swSerial->begin(baud);
+
+  return 1;
+}
+
+AD013_BaudControl AD013_SoftwareSerialBaud(SoftwareSerial & port) {
+
+  AD013_BaudControl baudCtl = { AD013_SoftwareSerialBegin, &port };
+  return baudCtl;
+}
+#endif
+
+#ifdef AD013_HOST_BUILD
+int AD013_TtyBegin(void * port, long baud) {
+
+  int fd = (int)(intptr_t) port;
+  struct termios tty;
+  speed_t speed;
+
+  switch (baud) {
+    case   9600: speed =   B9600; break;
+    case  19200: speed =  B19200; break;
+    case  38400: speed =  B38400; break;
+    case  57600: speed =  B57600; break;
+    case 115200: speed = B115200; break;
+    case 230400: speed = B230400; break;
+    default:
+      AD013_LOG_ERROR("Unsupported tty speed %ld", baud);
+      return -1;
+  }
+
+  if (tcgetattr(fd, &tty) < 0) return -1;
+
+  // Raw 8N1, waits for pending output before switching
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+  if (tcsetattr(fd, TCSADRAIN, &tty) < 0) return -1;
+
+  // Bytes received at the old speed are garbage
+  tcflush(fd, TCIFLUSH);
+
+  return 1;
+}
+
+AD013_BaudControl AD013_TtyBaud(int fd) {
+
+  AD013_BaudControl baudCtl = { AD013_TtyBegin, (void *)(intptr_t) fd };
+  return baudCtl;
+}
+#endif
+
+int AD013_VerifyPassword(Stream & SensorCom, AD013_Params * params) {
+
+  AD013_Params myParams;
+    // Container for params
+
+  if (!params) {
+    myParams = AD013_DefaultParams;
+    // Adds the Password as the default command
+    AD013_AddParamN(&myParams, AD013_def_passwd, sizeof(AD013_def_passwd));
+  } else {
+    // Copies the params struct into the local variable
+    myParams = *params;
+  }
+
+  if (PS_VerifyPwd(SensorCom, &myParams) != AD013_CODE_OK) return -1;
+
+  // Wake-ups repeat the same handshake (e.g., custom passwords)
+  AD013_Power.auth = myParams;
+  AD013_Power.verified = true;
+
+  return 1;
+}
+
+int AD013_WriteReg(Stream & SensorCom, int reg, int val) {
+
+  AD013_Params params = AD013_DefaultParams;
+  int code = -1;
+
+  AD013_ClearParams(&params);
+  AD013_AddParam1(&params, reg); // Register Num. (1 byte)
+  AD013_AddParam1(&params, val); // Contents (1 byte)
+
+  if ((code = PS_WriteReg(SensorCom, &params)) != AD013_CODE_OK) {
+    AD013_LOG_ERROR("Cannot Write Register %d (code: %d)", reg, code);
+    return -1;
+  }
+
+  return 1;
+}
+
+int AD013_FindSensor(Stream            & SensorCom,
+                     int                 serSpeed,
+                     AD013_Params      * params,
+                     AD013_BaudControl * baudCtl) {
+  // Let's Check we have a sensor attached and we can
+  // verify the password. Use the params to modify the
+  // defaults
+
+  if (serSpeed < 0 && baudCtl) {
+    // Array Of Speeds To Try
+    long speedVals[5] = {115200, 57600, 38400, 19200, 9600};
+    // Debug Info
+    AD013_LOG_INFO("Looking for Fingerprint Sensor - checking 115200-9600 baud range");
+ 
+    // Check which Speed Works
+    for (int i = 0; i < sizeof(speedVals)/sizeof(long); i++) {
+      if (AD013_SetPortSpeed(baudCtl, speedVals[i]) < 0) break;
+      delay(100);
+      if (AD013_VerifyPassword(SensorCom, params) < 0) {
+        AD013_LOG_INFO("Checking Speed %ld baud ....: Not Supported", speedVals[i]);
+      } else {
+        AD013_LOG_INFO("Checking Speed %ld baud ....: Ok (Supported).", speedVals[i]);
+        return 1;
+      }
+    }
+    
+    // Debug
+    AD013_LOG_ERROR("All Speed Failed, Aborting.");
+
+    // ALL speeds fail, let's fail
+    return -1;
+    
+  } else {
+
+    // If Speed was requested, let's set the speed (the port
+    // is used as-is when it cannot be controlled)
+    if (serSpeed > 0 && AD013_SetPortSpeed(baudCtl, serSpeed) < 0 && baudCtl) return -1;
+    delay(50);
+  
+    // Execute the call
+    if (AD013_VerifyPassword(SensorCom, params) < 0) return -1;
+  }
+  
+  // All Done
+  return 1;
+}
+
+int AD013_FindSensorWarm(Stream            & SensorCom,
+                         int                 serSpeed,
+                         AD013_Params      * params,
+                         AD013_BaudControl * baudCtl) {
+
+  AD013_SysParams sysParams;
+
+  if (AD013_SessionValid()) {
+
+    // The sensor kept its state, only the port needs setting up
+    if (AD013_WarmSession.baud > 0) AD013_SetPortSpeed(baudCtl, AD013_WarmSession.baud);
+    while (SensorCom.available()) SensorCom.read();
+
+    // Liveness Probe (also a different sensor would not match)
+    if (AD013_ReadSysParamsFor(SensorCom, &sysParams, AD013_WARM_PROBE_TIMEOUT) > 0 &&
+        memcmp(sysParams.devId, AD013_WarmSession.devId, sizeof(sysParams.devId)) == 0 &&
+        AD013_PacketSizeUse(SensorCom, sysParams.packetSize) > 0) {
+      AD013_LOG_INFO("Warm Start (%ld baud)", AD013_WarmSession.baud);
+      return 1;
+    }
+
+    AD013_LOG_WARN("Cached Session not usable, full handshake");
+  }
+
+  AD013_SessionClear();
+
+  if (AD013_FindSensor(SensorCom, serSpeed, params, baudCtl) < 0) return -1;
+
+  // Remembers the link for the next reset
+  if (AD013_ReadSysParams(SensorCom, &sysParams) > 0) {
+    if (AD013_PacketSizeUse(SensorCom, sysParams.packetSize) < 0) return -1;
+    AD013_SessionSave(baudCtl ? sysParams.baud : 0, sysParams.devId);
+  }
+
+  return 1;
+}
+
+#ifndef AD013_HOST_BUILD
+int AD013_FindSensor(HardwareSerial & SensorCom, int serSpeed, AD013_Params * params) {
+
+  AD013_BaudControl baudCtl = AD013_HardwareSerialBaud(SensorCom);
+  return AD013_FindSensor((Stream &) SensorCom, serSpeed, params, &baudCtl);
+}
+
+int AD013_FindSensorWarm(HardwareSerial & SensorCom, int serSpeed, AD013_Params * params) {
+
+  AD013_BaudControl baudCtl = AD013_HardwareSerialBaud(SensorCom);
+  return AD013_FindSensorWarm((Stream &) SensorCom, serSpeed, params, &baudCtl);
+}
+#endif
+
+#ifdef AD013_HAS_SOFTWARE_SERIAL
+int AD013_FindSensor(SoftwareSerial & SensorCom, int serSpeed, AD013_Params * params) {
+
+  AD013_BaudControl baudCtl = AD013_SoftwareSerialBaud(SensorCom);
+  return AD013_FindSensor((Stream &) SensorCom, serSpeed, params, &baudCtl);
+}
+
+int AD013_FindSensorWarm(SoftwareSerial & SensorCom, int serSpeed, AD013_Params * params) {
+
+  AD013_BaudControl baudCtl = AD013_SoftwareSerialBaud(SensorCom);
+  return AD013_FindSensorWarm((Stream &) SensorCom, serSpeed, params, &baudCtl);
+}
+#endif
+
+void AD013_SessionClear(void) {
+  memset(&AD013_WarmSession, 0, sizeof(AD013_WarmSession));
+}
+
+uint16_t AD013_SessionSum(const AD013_Session * session) {
+  return AD013_Sum(0, (const byte *) session, offsetof(AD013_Session, sum));
+}
+
+bool AD013_SessionValid(void) {
+  return AD013_WarmSession.magic == AD013_SESSION_MAGIC &&
+         AD013_WarmSession.sum == AD013_SessionSum(&AD013_WarmSession);
+}
+
+void AD013_SessionSave(long baud, const char * devId) {
+
+  AD013_WarmSession.magic = AD013_SESSION_MAGIC;
+  AD013_WarmSession.baud = baud;
+  memmove(AD013_WarmSession.devId, devId, sizeof(AD013_WarmSession.devId));
+  AD013_WarmSession.sum = AD013_SessionSum(&AD013_WarmSession);
+}
+
+int AD013_ReadSysParams(Stream          & SensorCom,
+                        AD013_SysParams * sysParams) {
+  return AD013_ReadSysParamsFor(SensorCom, sysParams, AD013_DEF_TIMEOUT);
+}
+
+int AD013_ReadSysParamsFor(Stream          & SensorCom,
+                           AD013_SysParams * sysParams,
+                           unsigned long     timeout) {
+
+  char data[16] = { 0x00 };
+  char * pnt = data;
+  int len = sizeof(data);
+  int code = -1;
+
+  if (!sysParams) return -1;
+
+  if ((code = AD013_Send(0x0F, SensorCom, NULL, (byte **) &pnt, &len, timeout)) != AD013_CODE_OK ||
+      len < (int) sizeof(data)) {
+    AD013_LOG_ERROR("Cannot Read System Parameters (code: %d)", code);
+    return -1;
+  }
+
+  // Parses the (big-endian) parameters
+  sysParams->status = AD013_get_uint16_value(data);
+  sysParams->sensorType = AD013_get_uint16_value(data + 2);
+  sysParams->capacity = AD013_get_uint16_value(data + 4);
+  sysParams->securityLevel = AD013_get_uint16_value(data + 6);
+  memcpy(sysParams->devId, data + 8, sizeof(sysParams->devId));
+  sysParams->packetSize = 32 << (AD013_get_uint16_value(data + 12) & 0x03);
+  sysParams->baud = 9600L * AD013_get_uint16_value(data + 14);
+
+  return 1;
+}
+
+int AD013_GetPacketSize(Stream & SensorCom) {
+
+  AD013_SysParams sysParams;
+
+  if (AD013_ReadSysParams(SensorCom, &sysParams) < 0) return -1;
+
+  // Data packets we send must match the sensor's size
+  return AD013_PacketSizeUse(SensorCom, sysParams.packetSize);
+}
+
+int AD013_PacketSizeUse(Stream & SensorCom, int size) {
+
+  int code = 3;
+
+  // Larger packets than our buffers cannot be received, the
+  // sensor is moved down to AD013_MAX_PACKET_SIZE
+  if (size > AD013_MAX_PACKET_SIZE) {
+    for (size = 256; size > AD013_MAX_PACKET_SIZE; size >>= 1) code--;
+    AD013_LOG_WARN("Data Packet Size too large, lowering to %d bytes", size);
+    if (AD013_WriteReg(SensorCom, AD013_REG_PACKET_SIZE, code) < 0) {
+      AD013_LOG_ERROR("Cannot lower the Data Packet Size");
+      return -1;
+    }
+  }
+
+  AD013_PacketSize = size;
+
+  return size;
+}
+
+int AD013_SetPacketSize(Stream & SensorCom, int maxSize) {
+
+  int size = 256;
+  int code = 3;
+
+  // Largest supported size that fits the buffers
+  if (maxSize < 0 || maxSize > AD013_MAX_PACKET_SIZE) maxSize = AD013_MAX_PACKET_SIZE;
+  while (code > 0 && size > maxSize) {
+    size >>= 1;
+    code--;
+  }
+  if (size > maxSize) return -1;
+
+  if (AD013_GetPacketSize(SensorCom) == size) return size;
+
+  if (AD013_WriteReg(SensorCom, AD013_REG_PACKET_SIZE, code) < 0) return -1;
+
+  AD013_PacketSize = size;
+
+  AD013_LOG_INFO("Data Packet Size set to %d bytes", size);
+
+  return size;
+}
+
+int AD013_SetBaudRate(Stream            & SensorCom,
+                      AD013_BaudControl * baudCtl,
+                      long                baud,
+                      AD013_Params      * params) {
+
+  AD013_SysParams sysParams;
+  long oldBaud = 0;
+
+  // The sensor supports N x 9600 baud (N = 1 .. 12)
+  if (baud < 9600 || baud > 115200 || baud % 9600 != 0) return -1;
+
+  // We need to re-open the port at the new speed
+  if (!baudCtl || !baudCtl->begin) return -1;
+
+  if (AD013_ReadSysParams(SensorCom, &sysParams) < 0) return -1;
+  if ((oldBaud = sysParams.baud) == baud) return 1;
+
+  AD013_LOG_INFO("Switching Baud Rate from %ld to %ld", oldBaud, baud);
+
+  // The ACK is sent at the current rate
+  if (AD013_WriteReg(SensorCom, AD013_REG_BAUD_RATE, baud / 9600) < 0) return -1;
+
+  // Re-opens the port at the new rate and checks the link
+  SensorCom.flush();
+  if (AD013_SetPortSpeed(baudCtl, baud) > 0) {
+    delay(50);
+    if (AD013_VerifyPassword(SensorCom, params) > 0) {
+      // The cached session follows the new rate
+      if (AD013_SessionValid() && AD013_WarmSession.baud > 0) {
+        AD013_SessionSave(baud, AD013_WarmSession.devId);
+      }
+      return 1;
+    }
+  }
+
+  AD013_LOG_ERROR("No Link at %ld baud, rolling back to %ld", baud, oldBaud);
+
+  // Rolls back: the sensor might still be at the old rate...
+  if (AD013_SetPortSpeed(baudCtl, oldBaud) > 0) {
+    delay(50);
+    if (AD013_VerifyPassword(SensorCom, params) > 0) return -1;
+  }
+
+  // ... otherwise it switched, but the new rate is not usable
+  // from our side, so we ask it to go back (best effort)
+  if (AD013_SetPortSpeed(baudCtl, baud) > 0) {
+    delay(50);
+    AD013_WriteReg(SensorCom, AD013_REG_BAUD_RATE, oldBaud / 9600);
+    SensorCom.flush();
+    AD013_SetPortSpeed(baudCtl, oldBaud);
+    delay(50);
+    AD013_VerifyPassword(SensorCom, params);
+  }
+
+  return -1;
+}
+
+unsigned long AD013_SearchTimeout(bool bounded, unsigned long limit) {
+
+  long left = AD013_DeadlineLeft(limit);
+
+  if (!bounded || left >= (long) AD013_DEF_TIMEOUT) return AD013_DEF_TIMEOUT;
+
+  // Commands still get sent (and fail) once the budget is over
+  return left > 0 ? left : 1;
+}
+
+int AD013_SearchRun(Stream             & SensorCom,
+                    int                  timeOut,
+                    bool                 bounded,
+                    unsigned long        limit,
+                    int                  threashold,
+                    bool                 SecurityOfficerOnly,
+                    AD013_SearchResult * result) {
+
+  AD013_SearchResult myResult;
+  AD013_Params params = AD013_DefaultParams;
+  unsigned long deadline = 0;
+  unsigned long wakeBy = 0;
+  unsigned long start = millis();
+  int templates = SecurityOfficerOnly ? AD013_SO_TEMPLATES : AD013_MAX_TEMPLATES;
+  int delayPeriod = 120;
+  int code = -1;
+  long left = 0;
+  uint32_t hash = 0;
+  bool hashed = false;
+
+  // Search Reply (Page ID and Score)
+  byte buff[4] = { 0x00 };
+  byte * data = buff;
+  int len = sizeof(buff);
+
+  if (!result) result = &myResult;
+
+  memset(result, 0, sizeof(AD013_SearchResult));
+  result->templateId = -1;
+  result->status = AD013_SEARCH_IO_ERROR;
+
+  // Late replies of an aborted command would be taken for ours
+  if (bounded) while (SensorCom.available()) SensorCom.read();
+
+  // Wakes the module up first, so that the wake-up latency
+  // does not eat into the time allowed for the finger
+  wakeBy = AD013_DeadlineIn(AD013_POWER_WAKE_TIMEOUT);
+  if (bounded && (long)(limit - wakeBy) < 0) wakeBy = limit;
+  if (AD013_PowerWakeBy(SensorCom, wakeBy) < 0) {
+    if (bounded && AD013_DeadlinePassed(limit)) result->status = AD013_SEARCH_DEADLINE;
+    return -1;
+  }
+  result->wakeMs = millis() - start;
+
+  // The capture leaves enough time for the Char and the search
+  if (bounded) {
+    deadline = limit - (AD013_BOUND_EXTRACT_MS + AD013_BOUND_SEARCH_MS +
+                        AD013_BOUND_TEMPLATE_MS * templates);
+    if ((long)(deadline - millis()) < 0) deadline = millis();
+  } else {
+    deadline = AD013_DeadlineIn(timeOut);
+  }
+
+  // Debug Information
+  AD013_LOG_INFO("Please put finger on sensor...");
+
+  // Captures the Image (Code 0x02 is for Fingerprint NOT on sensor)
+  start = millis();
+  while ((code = AD013_Send(0x01, SensorCom, NULL, NULL, NULL,
+                            AD013_SearchTimeout(bounded, limit))) != AD013_CODE_OK) {
+
+    result->attempts++;
+
+    // Checks for specific errors
+    if (code != AD013_CODE_NO_FINGER) {
+      AD013_LOG_ERROR("Cannot Get Image (code: %d)", code);
+    }
+
+    // Checks for Timeout Conditions
+    if (AD013_DeadlinePassed(deadline)) {
+      AD013_LOG_WARN("Timeout Reached, aborting...");
+      break;
+    }
+    left = AD013_DeadlineLeft(deadline);
+    delay(left < delayPeriod ? left : delayPeriod);
+  }
+  result->captureMs = millis() - start;
+  result->code = code;
+
+  // If we do not have a successful finger on
+  // the sensor, let's abort
+  if (code != AD013_CODE_OK) {
+    if (code == AD013_CODE_NO_FINGER) result->status = AD013_SEARCH_TIMEOUT;
+    else if (code > 0) result->status = AD013_SEARCH_BAD_IMAGE;
+    else if (bounded && AD013_DeadlinePassed(limit)) result->status = AD013_SEARCH_DEADLINE;
+    return -1;
+  }
+  result->attempts++;
+
+  // Generates the Char from the acquired Image (Buffer 1)
+  if (bounded && AD013_DeadlinePassed(limit)) {
+    result->status = AD013_SEARCH_DEADLINE;
+    return -1;
+  }
+  start = millis();
+  AD013_AddParam1(&params, 1);
+  code = AD013_Send(0x02, SensorCom, &params, NULL, NULL, AD013_SearchTimeout(bounded, limit));
+  result->extractMs = millis() - start;
+  result->code = code;
+
+  if (code != AD013_CODE_OK) {
+    AD013_LOG_ERROR("Cannot Generate Char (code: %d)", code);
+    if (code > 0) result->status = AD013_SEARCH_BAD_IMAGE;
+    else if (bounded && AD013_DeadlinePassed(limit)) result->status = AD013_SEARCH_DEADLINE;
+    return -1;
+  }
+
+  // Templates the search can cover in the time left
+  if (bounded) {
+    left = AD013_DeadlineLeft(limit) - AD013_BOUND_SEARCH_MS;
+    if (left < (long) AD013_BOUND_TEMPLATE_MS * templates) {
+      templates = left > 0 ? left / AD013_BOUND_TEMPLATE_MS : 0;
+    }
+    if (templates <= 0) {
+      AD013_LOG_WARN("No Time left for the Search");
+      result->status = AD013_SEARCH_DEADLINE;
+      return -1;
+    }
+  }
+  result->searched = templates;
+
+  // A re-presentation of a recently matched finger is only matched
+  // against that Template (the Char is only uploaded while matches
+  // are cached). The hash picks the candidate, PS_Match decides.
+  // Bounded searches do not use the cache: the Char upload cannot be
+  // cut short
+  start = millis();
+  if (!bounded && AD013_MatchCacheLive() &&
+      AD013_CharHashUpload(SensorCom, 1, &hash) > 0) {
+    hashed = true;
+    // Only candidates in the searched range (e.g., the SO's)
+    if ((result->templateId = AD013_MatchCacheLookup(hash)) >= 0 &&
+        result->templateId < templates &&
+        AD013_MatchCacheConfirm(SensorCom, result->templateId, &result->score) > 0 &&
+        result->score >= threashold) {
+      result->searchMs = millis() - start;
+      result->status = AD013_SEARCH_OK;
+      result->cached = true;
+      AD013_ScoreStatsAdd(result->templateId, result->score, true);
+      AD013_LOG_INFO("Matched Template: %d (Cached, Score: %d)",
+        result->templateId, result->score);
+      return result->templateId;
+    }
+    result->templateId = -1;
+    result->score = 0;
+  }
+
+  // Searches the DB (the SO's range only, if requested)
+  AD013_ClearParams(&params);
+  AD013_AddParam1(&params, 1); // Buffer Num. (1 byte)
+  AD013_AddParam2(&params, 0); // Start Num. (2 bytes)
+  AD013_AddParam2(&params, templates); // Templates (2 bytes)
+
+  code = AD013_Send(0x04, SensorCom, &params, &data, &len, AD013_SearchTimeout(bounded, limit));
+  result->searchMs = millis() - start;
+  result->code = code;
+
+  if (code == AD013_CODE_FINGER_NOT_FOUND) {
+    // Not in the searched part only, no answer
+    if (templates < (SecurityOfficerOnly ? AD013_SO_TEMPLATES : AD013_MAX_TEMPLATES)) {
+      AD013_LOG_INFO("No Matching Template in 0-%d", templates - 1);
+      result->status = AD013_SEARCH_DEADLINE;
+      return -1;
+    }
+    AD013_LOG_INFO("No Matching Template");
+    AD013_ScoreStatsAdd(-1, 0, false);
+    result->status = AD013_SEARCH_NOT_FOUND;
+    return -1;
+  }
+
+  if (code != AD013_CODE_OK || len < 4) {
+    AD013_LOG_ERROR("Cannot Search Templates (code: %d)", code);
+    if (code < 0 && bounded && AD013_DeadlinePassed(limit)) result->status = AD013_SEARCH_DEADLINE;
+    return -1;
+  }
+
+  result->templateId = AD013_get_uint16_value((char *) data);
+  result->score = AD013_get_uint16_value((char *) &data[2]);
+
+  // Every score counts, accepted or not
+  AD013_ScoreStatsAdd(result->templateId, result->score, result->score >= threashold);
+
+  if (result->score < threashold) {
+    AD013_LOG_INFO("Rejected Template: %d (Score: %d < %d)",
+      result->templateId, result->score, threashold);
+    result->status = AD013_SEARCH_LOW_SCORE;
+    return -1;
+  }
+
+  result->status = AD013_SEARCH_OK;
+
+  AD013_LOG_INFO("Matched Template: %d (Score: %d)", result->templateId, result->score);
+
+  // Remembers the match for re-presentations
+  if (AD013_MATCH_CACHE_SIZE > 0 && !bounded &&
+      (hashed || AD013_CharHashUpload(SensorCom, 1, &hash) > 0)) {
+    AD013_MatchCacheAdd(hash, result->templateId, result->score);
+  }
+
+  return result->templateId;
+}
+
+/* !\brief Searches for a Match in the Fingerprint Database */
+
+int AD013_SearchTemplate (Stream             & SensorCom,
+                          int                  timeOut,
+                          int                  threashold,
+                          bool                 SecurityOfficerOnly,
+                          AD013_SearchResult * result) {
+
+  return AD013_SearchRun(SensorCom, timeOut, false, 0, threashold,
+                         SecurityOfficerOnly, result);
+}
+
+/* !\brief Searches for a Match within a hard time budget */
+
+int AD013_SearchTemplateWithin (Stream             & SensorCom,
+                                unsigned long        budget,
+                                int                  threashold,
+                                bool                 SecurityOfficerOnly,
+                                AD013_SearchResult * result) {
+
+  return AD013_SearchRun(SensorCom, 0, true, AD013_DeadlineIn(budget), threashold,
+                         SecurityOfficerOnly, result);
+}
+
+/* !\brief Clears one template from the fingerprint DB */
+
+int AD013_ClearTemplates (Stream & SensorCom,
+                          int      rangeStart,
+                          int      rangeEnd) {
+
+  AD013_Params params = AD013_DefaultParams;
+  int code = -1;
+
+  if (rangeStart < 0 || rangeEnd < rangeStart) return -1;
+
+  // A single PS_DeletChar removes the whole range
+  AD013_ClearParams(&params);
+  AD013_AddParam2(&params, rangeStart);                // Page Num. (2 bytes)
+  AD013_AddParam2(&params, rangeEnd - rangeStart + 1); // Count (2 bytes)
+
+  // The slots' contents change (even if the command fails)
+  AD013_TemplateCacheBump(rangeStart, rangeEnd);
+
+  if ((code = PS_DeletChar(SensorCom, &params)) != AD013_CODE_OK) {
+    AD013_LOG_ERROR("Cannot Delete Templates %d-%d (code: %d)",
+        rangeStart, rangeEnd, code);
+    return -1;
+  }
+
+  return 1;
+}
+
+                      
+/* !\brief Clears all user templates from the fingerprint DB */
+
+int AD013_ClearUserTemplates (Stream & SensorCom) {
+  return AD013_ClearTemplates(SensorCom, AD013_SO_TEMPLATES, AD013_MAX_TEMPLATES - 1);
+}
+
+
+/* !\brief Clears all the Security Officer (SO) templates from the
+           fingerprint DB */
+
+int AD013_ClearSecurityOfficerTemplates(Stream & SensorCom) {
+  return AD013_ClearTemplates(SensorCom, 0, AD013_SO_TEMPLATES - 1);
+}
+
+/* !\brief Reads the occupancy bitmap of the fingerprint DB */
+
+int AD013_ReadIndexTable(Stream & SensorCom,
+                         byte   * bitmap,
+                         int      bitmap_len) {
+
+  AD013_Params params = AD013_DefaultParams;
+  byte * data = NULL;
+  int len = 0;
+  int code = -1;
+
+  if (!bitmap || bitmap_len < 1) return -1;
+
+  // Each Index Page covers AD013_INDEX_PAGE_SIZE bytes of the bitmap
+  for (int page = 0; page * AD013_INDEX_PAGE_SIZE < bitmap_len; page++) {
+
+    data = bitmap + page * AD013_INDEX_PAGE_SIZE;
+    len = bitmap_len - page * AD013_INDEX_PAGE_SIZE;
+    if (len > AD013_INDEX_PAGE_SIZE) len = AD013_INDEX_PAGE_SIZE;
+
+    AD013_ClearParams(&params);
+    AD013_AddParam1(&params, page); // Index Page (1 byte)
+
+    if ((code = PS_ReadIndexTable(SensorCom, &params, &data, &len)) != AD013_CODE_OK) {
+      AD013_LOG_ERROR("Cannot Read Index Table %d (code: %d)", page, code);
+      return -1;
+    }
+  }
+
+  return 1;
+}
+
+int AD013_EnrollCapture(Stream & SensorCom, bool lift) {
+
+  unsigned long deadline = AD013_DeadlineIn(AD013_ENROLL_TIMEOUT);
+  int delayPeriod = 120;
+  int code = -1;
+
+  // Waits for the finger to be lifted (a new placement is needed)...
+  while (lift && (code = PS_GetImage(SensorCom)) != AD013_CODE_NO_FINGER) {
+    if (AD013_DeadlinePassed(deadline)) {
+      AD013_LOG_WARN("Finger not lifted, aborting...");
+      return -1;
+    }
+    delay(delayPeriod);
+  }
+
+  // ... and then placed again
+  deadline = AD013_DeadlineIn(AD013_ENROLL_TIMEOUT);
+  while ((code = PS_GetImage(SensorCom)) != AD013_CODE_OK) {
+    if (AD013_DeadlinePassed(deadline)) {
+      AD013_LOG_WARN("Timeout Reached, aborting...");
+      return -1;
+    }
+    delay(delayPeriod);
+  }
+
+  return 1;
+}
+
+// Searches for the Char in Char Buffer 1. Returns 1 and the Template
+// ID if found, 0 if not found and -1 on error
+int AD013_EnrollLookup(Stream & SensorCom, const byte * bitmap, int bitmap_len, int * templateId) {
+
+  AD013_Params params = AD013_DefaultParams;
+  byte buff[4] = { 0x00 };
+  byte * data = buff;
+  int len = sizeof(buff);
+  int lo = -1;
+  int hi = -1;
+  int code = -1;
+
+  // Occupied Range (nothing to search in an empty DB)
+  for (int id = 0; id < AD013_MAX_TEMPLATES && id < bitmap_len * 8; id++) {
+    if (AD013_IndexTableIsUsed(bitmap, id)) {
+      if (lo < 0) lo = id;
+      hi = id;
+    }
+  }
+  if (lo < 0) return 0;
+
+  AD013_ClearParams(&params);
+  AD013_AddParam1(&params, 1);           // Buffer Num. (1 byte)
+  AD013_AddParam2(&params, lo);          // Start Num. (2 bytes)
+  AD013_AddParam2(&params, hi - lo + 1); // Templates (2 bytes)
+
+  code = PS_Search(SensorCom, &params, &data, &len);
+  if (code == AD013_CODE_FINGER_NOT_FOUND) return 0;
+  if (code != AD013_CODE_OK || len < 2) {
+    AD013_LOG_ERROR("Cannot Search the DB (code: %d)", code);
+    return -1;
+  }
+
+  *templateId = AD013_get_uint16_value((char *) data);
+
+  return 1;
+}
+
+/* !\brief Enrolls a new Finger into the Sensor's DB */
+
+int AD013_Enroll(Stream         & SensorCom,
+                 bool             isSecurityOfficer,
+                 AD013_EnrollFunc feedback,
+                 void           * ctx,
+                 byte           * img,
+                 int              width,
+                 int              height,
+                 bool           * enrolled) {
+
+  AD013_Params params = AD013_DefaultParams;
+  AD013_ImageStats stats[AD013_ENROLL_SAMPLES];
+  AD013_EnrollSample sample;
+  byte bitmap[(AD013_MAX_TEMPLATES + 255) / 256 * AD013_INDEX_PAGE_SIZE];
+  int first = isSecurityOfficer ? 0 : AD013_SO_TEMPLATES;
+  int last = isSecurityOfficer ? AD013_SO_TEMPLATES : AD013_MAX_TEMPLATES;
+  int templateId = 0;
+  int existingId = -1;
+  int code = -1;
+
+  if (enrolled) *enrolled = false;
+  if (img && (width <= 0 || height <= 0)) return -1;
+
+  // Finds the free slot first (no captures for a full DB)
+  if (AD013_ReadIndexTable(SensorCom, bitmap, sizeof(bitmap)) < 0) return -1;
+  for (templateId = first; templateId < last; templateId++) {
+    if (!AD013_IndexTableIsUsed(bitmap, templateId)) break;
+  }
+  if (templateId >= last) {
+    AD013_LOG_ERROR("No Free Template Slot (%d-%d)", first, last - 1);
+    return -1;
+  }
+
+  memset(&sample, 0, sizeof(sample));
+
+  for (sample.index = 0; sample.index < AD013_ENROLL_SAMPLES; sample.index++) {
+
+    for (sample.attempt = 0; sample.attempt <= AD013_ENROLL_RETRIES; sample.attempt++) {
+
+      sample.duplicate = false;
+      sample.accepted = false;
+      sample.stats = NULL;
+
+      // Every capture is a new placement of the finger
+      if (AD013_EnrollCapture(SensorCom, sample.index > 0 || sample.attempt > 0) < 0) return -1;
+
+      sample.code = AD013_CODE_OK;
+
+      // The image predicts PS_GenChar failures and shows whether
+      // the finger was moved since the earlier samples
+      if (img) {
+        sample.stats = &stats[sample.index];
+        if (AD013_UpImage(SensorCom, img, (long) width * height) != (long) width * height ||
+            (sample.code = AD013_ImageQuality(img, width, height, &stats[sample.index])) < 0) {
+          return -1;
+        }
+        for (int i = 0; sample.code == AD013_CODE_OK && i < sample.index; i++) {
+          if (abs(stats[i].centerX - stats[sample.index].centerX) < AD013_ENROLL_MIN_SHIFT &&
+              abs(stats[i].centerY - stats[sample.index].centerY) < AD013_ENROLL_MIN_SHIFT) {
+            sample.duplicate = true;
+          }
+        }
+      }
+
+      // Each sample goes into its own Char Buffer (1-N)
+      if (sample.code == AD013_CODE_OK && !sample.duplicate) {
+        AD013_ClearParams(&params);
+        AD013_AddParam1(&params, sample.index + 1);
+        sample.code = PS_GenChar(SensorCom, &params);
+        if (sample.code < 0) return -1;
+      }
+
+      sample.accepted = (sample.code == AD013_CODE_OK && !sample.duplicate);
+
+      AD013_LOG_DEBUG("Enroll Sample %d/%d (code: %d, duplicate: %d)",
+        sample.index + 1, sample.attempt + 1, sample.code, sample.duplicate);
+
+      if (feedback && feedback(&sample, ctx) < 0) return -1;
+
+      if (sample.accepted) break;
+    }
+
+    if (!sample.accepted) {
+      AD013_LOG_ERROR("Cannot Enroll Sample %d (code: %d)", sample.index + 1, sample.code);
+      return -1;
+    }
+
+    // Already enrolled? The first Char is searched for right away,
+    // the remaining captures are spared if it is
+    if (sample.index == 0) {
+      if ((code = AD013_EnrollLookup(SensorCom, bitmap, sizeof(bitmap), &existingId)) < 0) return -1;
+      if (code > 0) {
+        AD013_LOG_INFO("Finger already enrolled (Template: %d)", existingId);
+        return existingId;
+      }
+    }
+  }
+
+  // Merges the Char Buffers into a Template (in Char Buffer 1)
+  if ((code = PS_RegModel(SensorCom)) != AD013_CODE_OK) {
+    AD013_LOG_ERROR("Cannot Merge Samples (code: %d)", code);
+    return -1;
+  }
+
+  if (AD013_StoreTemplate(SensorCom, 1, templateId) < 0) return -1;
+
+  if (enrolled) *enrolled = true;
+
+  return templateId;
+}
+
+/* !\brief Uploads the last captured image from the sensor */
+
+long AD013_UpImage(Stream       & SensorCom,
+                   byte         * buff,
+                   long           buff_len,
+                   AD013_DataSink sink,
+                   void         * ctx) {
+
+  int code = -1;
+
+  // We need a place for the image
+  if (!buff && !sink) return -1;
+
+  // Requests the upload of the Image Buffer
+  if ((code = PS_UpImage(SensorCom)) != AD013_CODE_OK) {
+    AD013_LOG_ERROR("Cannot Upload Image (code: %d)", code);
+    return -1;
+  }
+
+  // Receives the data packets
+  return AD013_RecvData(SensorCom, buff, buff_len, sink, ctx);
+}
+
+/* !\brief Loads a stored Template into a Char Buffer */
+
+int AD013_LoadTemplate(Stream & SensorCom,
+                       int      templateId,
+                       int      bufferId) {
+
+  AD013_Params params = AD013_DefaultParams;
+  int code = -1;
+
+  AD013_ClearParams(&params);
+  AD013_AddParam1(&params, bufferId);   // Buffer Num. (1 byte)
+  AD013_AddParam2(&params, templateId); // Page Num. (2 bytes)
+
+  if ((code = PS_LoadChar(SensorCom, &params)) != AD013_CODE_OK) {
+    // Nothing is stored at templateId
+    if (code == AD013_CODE_TEMPLATE_READ_ERROR) return 0;
+    AD013_LOG_ERROR("Cannot Load Template %d (code: %d)", templateId, code);
+    return -1;
+  }
+
+  return 1;
+}
+
+/* !\brief Stores a Char Buffer as a Template */
+
+int AD013_StoreTemplate(Stream & SensorCom,
+                        int      bufferId,
+                        int      templateId) {
+
+  AD013_Params params = AD013_DefaultParams;
+  int code = -1;
+
+  AD013_ClearParams(&params);
+  AD013_AddParam1(&params, bufferId);   // Buffer Num. (1 byte)
+  AD013_AddParam2(&params, templateId); // Page Num. (2 bytes)
+
+  // The slot's contents change (even if the command fails)
+  AD013_TemplateCacheBump(templateId, templateId);
+
+  if ((code = PS_StoreChar(SensorCom, &params)) != AD013_CODE_OK) {
+    AD013_LOG_ERROR("Cannot Store Template %d (code: %d)", templateId, code);
+    return -1;
+  }
+
+  return 1;
+}
+
+/* !\brief Uploads the contents of a Char Buffer from the sensor */
+
+long AD013_UpChar(Stream       & SensorCom,
+                  int            bufferId,
+                  byte         * buff,
+                  long           buff_len,
+                  AD013_DataSink sink,
+                  void         * ctx) {
+
+  AD013_Params params = AD013_DefaultParams;
+  int code = -1;
+
+  // We need a place for the template
+  if (!buff && !sink) return -1;
+
+  AD013_ClearParams(&params);
+  AD013_AddParam1(&params, bufferId);   // Buffer Num. (1 byte)
+
+  if ((code = PS_UpChar(SensorCom, &params)) != AD013_CODE_OK) {
+    AD013_LOG_ERROR("Cannot Upload Char (code: %d)", code);
+    return -1;
+  }
+
+  // Receives the data packets
+  return AD013_RecvData(SensorCom, buff, buff_len, sink, ctx);
+}
+
+/* !\brief Downloads a Template into a Char Buffer of the sensor */
+
+int AD013_DownChar(Stream     & SensorCom,
+                   int          bufferId,
+                   const byte * buff,
+                   long         buff_len) {
+
+  AD013_Params params = AD013_DefaultParams;
+  int code = -1;
+
+  if (!buff || buff_len <= 0) return -1;
+
+  AD013_ClearParams(&params);
+  AD013_AddParam1(&params, bufferId);   // Buffer Num. (1 byte)
+
+  if ((code = PS_DownChar(SensorCom, &params)) != AD013_CODE_OK) {
+    AD013_LOG_ERROR("Cannot Download Char (code: %d)", code);
+    return -1;
+  }
+
+  // Sends the data packets
+  if (AD013_SendData(SensorCom, buff, buff_len) != buff_len) return -1;
+
+  return 1;
+}
+
+                        // ========================
+                        // Template Cache Functions
+                        // ========================
+
+void AD013_TemplateCacheBump(int startId, int endId) {
+
+  // Cached matches of these slots are stale as well
+  AD013_MatchCacheDrop(startId, endId);
+
+  if (startId < 0) startId = 0;
+  if (endId >= AD013_TEMPLATE_CACHE_SIZE) endId = AD013_TEMPLATE_CACHE_SIZE - 1;
+
+  // Invalidates the hashes by moving to a new generation (the hash
+  // is cleared too, so that the 8-bit counter wrapping around after
+  // 256 bumps cannot revive it)
+  for (int id = startId; id <= endId; id++) {
+    AD013_TemplateCache[id].gen++;
+    AD013_TemplateCache[id].hash = 0;
+  }
+}
+
+uint32_t AD013_TemplateCacheGet(int templateId) {
+
+  AD013_TemplateCacheEntry * entry = NULL;
+
+  if (templateId < 0 || templateId >= AD013_TEMPLATE_CACHE_SIZE) return 0;
+
+  // Hashes from older generations are stale
+  entry = &AD013_TemplateCache[templateId];
+  return (entry->hash_gen == entry->gen ? entry->hash : 0);
+}
+
+void AD013_TemplateCacheSet(int templateId, uint32_t hash) {
+
+  if (templateId < 0 || templateId >= AD013_TEMPLATE_CACHE_SIZE) return;
+
+  AD013_TemplateCache[templateId].hash = hash;
+  AD013_TemplateCache[templateId].hash_gen = AD013_TemplateCache[templateId].gen;
+}
+
+uint8_t AD013_TemplateCacheGeneration(int templateId) {
+
+  if (templateId < 0 || templateId >= AD013_TEMPLATE_CACHE_SIZE) return 0;
+
+  return AD013_TemplateCache[templateId].gen;
+}
+
+void AD013_TemplateCacheReset(void) {
+
+  // Forgets all hashes, generations keep counting
+  AD013_TemplateCacheBump(0, AD013_TEMPLATE_CACHE_SIZE - 1);
+}
+
+/* !\brief Fetches a stored Template unless known to be unchanged */
+
+long AD013_FetchTemplate(Stream & SensorCom,
+                         int      templateId,
+                         byte   * buff,
+                         long     buff_len,
+                         bool     force) {
+
+  long len = 0;
+
+  // Skips slots whose contents did not change since the last fetch
+  if (!force && AD013_TemplateCacheGet(templateId) != 0) return 0;
+
+  if (AD013_LoadTemplate(SensorCom, templateId, 1) <= 0 ||
+      (len = AD013_UpChar(SensorCom, 1, buff, buff_len)) < 0)
+    return -1;
+
+  AD013_TemplateCacheSet(templateId, AD013_Crc32(0, buff, len));
+
+  return len;
+}
+
+uint32_t AD013_Crc32(uint32_t crc, const byte * data, long data_len) {
+
+  // Bitwise CRC32 (IEEE 802.3, reflected)
+  crc = ~crc;
+  for (long i = 0; i < data_len; i++) {
+    crc ^= data[i];
+    for (int j = 0; j < 8; j++)
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+
+  return ~crc;
+}
+
+                        // =====================
+                        // Match Cache Functions
+                        // =====================
+
+int AD013_SimHashSink(const byte * data, int data_len, void * ctx) {
+
+  AD013_SimHashCtx * sh = (AD013_SimHashCtx *) ctx;
+  uint32_t h = 0;
+
+  // Features are the byte pairs of the Char, so that a few changed
+  // bytes only move a few of the 32 counters across zero. Runs of the
+  // same byte (e.g., the zero padding) would outweigh the rest of the
+  // Char, so they are left out
+  for (int i = 0; i < data_len; i++) {
+
+    if (sh->prev >= 0 && sh->prev != data[i]) {
+      h = (((uint32_t) sh->prev << 8) | data[i]) * 0x9E3779B1UL;
+      h ^= h >> 15;
+      h *= 0x85EBCA77UL;
+      h ^= h >> 13;
+      for (int b = 0; b < 32; b++) sh->bits[b] += ((h >> b) & 1) ? 1 : -1;
+    }
+
+    sh->prev = data[i];
+  }
+
+  return 1;
+}
+
+uint32_t AD013_SimHashFinal(const AD013_SimHashCtx * sh) {
+
+  uint32_t hash = 0;
+
+  for (int b = 0; b < 32; b++) {
+    if (sh->bits[b] > 0) hash |= (1UL << b);
+  }
+
+  return hash;
+}
+
+long AD013_CharHashUpload(Stream & SensorCom, int bufferId, uint32_t * hash) {
+
+  AD013_SimHashCtx sh;
+  long len = 0;
+
+  memset(&sh, 0, sizeof(sh));
+  sh.prev = -1;
+
+  // The Char is hashed as it arrives, it is never stored
+  if ((len = AD013_UpChar(SensorCom, bufferId, NULL, 0, AD013_SimHashSink, &sh)) <= 0)
+    return -1;
+
+  *hash = AD013_SimHashFinal(&sh);
+
+  return len;
+}
+
+int AD013_MatchCacheConfirm(Stream & SensorCom, int templateId, int * score) {
+
+  byte buff[2] = { 0x00 };
+  byte * data = buff;
+  int len = sizeof(buff);
+  int code = -1;
+
+  // The candidate Template goes into Char Buffer 2, then it is
+  // matched against the searched Char (Buffer 1)
+  if (AD013_LoadTemplate(SensorCom, templateId, 2) <= 0) return -1;
+
+  if ((code = PS_Match(SensorCom, &data, &len)) != AD013_CODE_OK || len < 2) {
+    if (code != AD013_CODE_FINGER_NOT_MATCHED) {
+      AD013_LOG_ERROR("Cannot Match Template %d (code: %d)", templateId, code);
+    }
+    return -1;
+  }
+
+  *score = AD013_get_uint16_value((char *) data);
+
+  return 1;
+}
+
+void AD013_MatchCacheDrop(int startId, int endId) {
+
+  for (int i = 0; i < AD013_MATCH_CACHE_SIZE; i++) {
+    if (AD013_MatchCache[i].id >= startId && AD013_MatchCache[i].id <= endId)
+      AD013_MatchCache[i].used = false;
+  }
+}
+
+uint32_t AD013_CharHash(const byte * data, long data_len) {
+
+  AD013_SimHashCtx sh;
+
+  memset(&sh, 0, sizeof(sh));
+  sh.prev = -1;
+
+  for (long pos = 0; pos < data_len; pos += 0x4000) {
+    AD013_SimHashSink(data + pos, data_len - pos > 0x4000 ? 0x4000 : data_len - pos, &sh);
+  }
+
+  return AD013_SimHashFinal(&sh);
+}
+
+int AD013_MatchCacheLookup(uint32_t hash, int * score) {
+
+  AD013_MatchCacheEntry * entry = NULL;
+  AD013_MatchCacheEntry * best = NULL;
+  uint32_t diff = 0;
+  int dist = 0;
+  int best_dist = AD013_MATCH_CACHE_MAX_DIST + 1;
+
+  for (int i = 0; i < AD013_MATCH_CACHE_SIZE; i++) {
+
+    entry = &AD013_MatchCache[i];
+    if (!entry->used) continue;
+
+    // Expired
+    if (millis() - entry->time >= AD013_MATCH_CACHE_TTL) {
+      entry->used = false;
+      continue;
+    }
+
+    // Hamming Distance
+    for (diff = entry->hash ^ hash, dist = 0; diff; diff &= diff - 1) dist++;
+
+    if (dist < best_dist) {
+      best = entry;
+      best_dist = dist;
+    }
+  }
+
+  if (!best) return -1;
+
+  if (score) *score = best->score;
+
+  return best->id;
+}
+
+void AD013_MatchCacheAdd(uint32_t hash, int templateId, int score) {
+
+  AD013_MatchCacheEntry * entry = NULL;
+
+  if (AD013_MATCH_CACHE_SIZE <= 0 || templateId < 0) return;
+
+  // First free (or oldest) entry
+  for (int i = 0; i < AD013_MATCH_CACHE_SIZE; i++) {
+    if (!AD013_MatchCache[i].used) {
+      entry = &AD013_MatchCache[i];
+      break;
+    }
+    if (!entry || (long)(AD013_MatchCache[i].time - entry->time) < 0) {
+      entry = &AD013_MatchCache[i];
+    }
+  }
+
+  entry->hash = hash;
+  entry->time = millis();
+  entry->id = templateId;
+  entry->score = score;
+  entry->used = true;
+}
+
+bool AD013_MatchCacheLive(void) {
+
+  for (int i = 0; i < AD013_MATCH_CACHE_SIZE; i++) {
+    if (AD013_MatchCache[i].used && millis() - AD013_MatchCache[i].time < AD013_MATCH_CACHE_TTL)
+      return true;
+  }
+
+  return false;
+}
+
+void AD013_MatchCacheReset(void) {
+  AD013_MatchCacheDrop(0, 0x7FFF);
+}
+
+                        // ==========================
+                        // Score Statistics Functions
+                        // ==========================
+
+void AD013_ScoreStatsAdd(int templateId, int score, bool accepted) {
+
+  AD013_TemplateScores * tpl = NULL;
+  int bucket = score / AD013_SCORE_BUCKET_WIDTH;
+
+  // Nothing matched
+  if (templateId < 0) {
+    if (AD013_Scores.notFound < 0xFFFF) AD013_Scores.notFound++;
+    return;
+  }
+
+  if (score < 0) score = bucket = 0;
+  if (bucket >= AD013_SCORE_BUCKETS) bucket = AD013_SCORE_BUCKETS - 1;
+
+  if (accepted) {
+    if (AD013_Scores.accepted[bucket] < 0xFFFF) AD013_Scores.accepted[bucket]++;
+  } else {
+    if (AD013_Scores.rejected[bucket] < 0xFFFF) AD013_Scores.rejected[bucket]++;
+  }
+
+  if (templateId >= AD013_SCORE_STATS_TEMPLATES) return;
+
+  tpl = &AD013_Scores.templates[templateId];
+
+  if (tpl->accepted == 0 && tpl->rejected == 0) {
+    tpl->minScore = tpl->maxScore = score;
+  } else {
+    if (score < tpl->minScore) tpl->minScore = score;
+    if (score > tpl->maxScore) tpl->maxScore = score;
+  }
+
+  // The sum stops with the counters (keeps the mean right)
+  if (accepted && tpl->accepted < 0xFFFF) {
+    tpl->accepted++;
+    tpl->sum += score;
+  } else if (!accepted && tpl->rejected < 0xFFFF) {
+    tpl->rejected++;
+    tpl->sum += score;
+  }
+}
+
+void AD013_ScoreStatsGet(AD013_ScoreStats * stats) {
+
+  if (!stats) return;
+
+  *stats = AD013_Scores;
+}
+
+int AD013_ScoreStatsExport(Print & out) {
+
+  const AD013_TemplateScores * tpl = NULL;
+  uint32_t count = 0;
+  int lines = 0;
+
+  for (int i = 0; i < AD013_SCORE_BUCKETS; i++) {
+    out.print("bucket,");
+    out.print(i * AD013_SCORE_BUCKET_WIDTH);
+    out.print(',');
+    out.print(AD013_Scores.accepted[i]);
+    out.print(',');
+    out.println(AD013_Scores.rejected[i]);
+    lines++;
+  }
+
+  out.print("notfound,");
+  out.println(AD013_Scores.notFound);
+  lines++;
+
+  for (int id = 0; id < AD013_SCORE_STATS_TEMPLATES; id++) {
+
+    tpl = &AD013_Scores.templates[id];
+    if ((count = (uint32_t) tpl->accepted + tpl->rejected) == 0) continue;
+
+    out.print("template,");
+    out.print(id);
+    out.print(',');
+    out.print(tpl->accepted);
+    out.print(',');
+    out.print(tpl->rejected);
+    out.print(',');
+    out.print(tpl->minScore);
+    out.print(',');
+    out.print(tpl->maxScore);
+    out.print(',');
+    out.println(tpl->sum / count);
+    lines++;
+  }
+
+  return lines;
+}
+
+void AD013_ScoreStatsReset(void) {
+  memset(&AD013_Scores, 0, sizeof(AD013_Scores));
+}
+
+                        // ==========================
+                        // Image Processing Functions
+                        // ==========================
+
+/* !\brief Estimates the quality of a captured image */
+
+int AD013_ImageQuality(const byte       * img,
+                       int                width,
+                       int                height,
+                       AD013_ImageStats * stats) {
+
+  const int bs = AD013_QUALITY_BLOCK_SIZE;
+
+  AD013_ImageStats myStats = { 0x00 };
+  uint32_t hist[16] = { 0x00 };
+  uint32_t pixels = 0;
+  uint32_t total = 0;
+  uint32_t ridge_pixels = 0;
+  uint32_t light = 0;
+  uint32_t dark = 0;
+  uint16_t blocks = 0;
+  uint16_t ridge_blocks = 0;
+  uint32_t ridge_x = 0;
+  uint32_t ridge_y = 0;
+  uint32_t acc = 0;
+  int lo = 0, hi = 15;
+
+  if (!img || width < bs || height < bs + 1) return -1;
+  if (!stats) stats = &myStats;
+
+  // Block Pass. The inner loops are kept branch-free over
+  // fixed size rows so that host compilers can vectorize them
+  for (int by = 0; by + bs < height; by += bs) {
+    for (int bx = 0; bx + bs <= width; bx += bs) {
+
+      AD013_BlockSum blk_sum = 0;
+      AD013_BlockSum blk_grad = 0;
+      uint16_t blk_light = 0;
+      uint16_t blk_dark = 0;
+
+      for (int y = 0; y < bs; y++) {
+        const byte * row = img + (long) (by + y) * width + bx;
+        const byte * next = row + width;
+
+        for (int x = 0; x < bs; x++) {
+          blk_sum   += row[x];
+          blk_light += (row[x] >= AD013_QUALITY_LIGHT_LEVEL);
+          blk_dark  += (row[x] <  AD013_QUALITY_DARK_LEVEL);
+          blk_grad  += abs((int) row[x] - (int) next[x]);
+        }
+        for (int x = 0; x < bs - 1; x++) {
+          blk_grad  += abs((int) row[x + 1] - (int) row[x]);
+        }
+        for (int x = 0; x < bs; x++) {
+          hist[row[x] >> 4]++;
+        }
+      }
+
+      // Blocks with enough gradient energy have ridges
+      if (blk_grad >= AD013_QUALITY_RIDGE_GRADIENT * (2 * bs - 1) * bs) {
+        ridge_blocks++;
+        ridge_pixels += bs * bs;
+        ridge_x += bx + bs / 2;
+        ridge_y += by + bs / 2;
+        light += blk_light;
+        dark += blk_dark;
+      }
+
+      total += blk_sum;
+      pixels += bs * bs;
+      blocks++;
+    }
+  }
+
+  // Gets the 5th and 95th percentiles from the histogram
+  for (acc = 0; lo < 15 && (acc += hist[lo]) < pixels / 20; lo++);
+  for (acc = 0; hi > 0 && (acc += hist[hi]) < pixels / 20; hi--);
+
+  stats->mean = total / pixels;
+  stats->contrast = hi > lo ? ((hi - lo + 1) << 4) - 1 : 0;
+  stats->coverage = (100UL * ridge_blocks) / blocks;
+  stats->dryness = ridge_pixels ? (100UL * light) / ridge_pixels : 0;
+  stats->wetness = ridge_pixels ? (100UL * dark) / ridge_pixels : 0;
+  stats->centerX = ridge_blocks ? (100UL * ridge_x) / ridge_blocks / width : 50;
+  stats->centerY = ridge_blocks ? (100UL * ridge_y) / ridge_blocks / height : 50;
+
+  AD013_LOG_DEBUG("Image Quality: mean %d, contrast %d, coverage %d%%, dry %d%%, wet %d%%",
+    stats->mean, stats->contrast, stats->coverage, stats->dryness, stats->wetness);
+
+  // Predicts the outcome of PS_GenChar
+  if (stats->contrast < AD013_QUALITY_MIN_CONTRAST) {
+    if (stats->mean >= AD013_QUALITY_LIGHT_LEVEL) return AD013_CODE_FEATURE_FAIL_LIGTH_DRY;
+    if (stats->mean <  AD013_QUALITY_DARK_LEVEL) return AD013_CODE_FEATURE_FAIL_DARK_WET;
+    return AD013_CODE_FEATURE_FAIL_AMORPHOUS;
+  }
+
+  if (stats->coverage < AD013_QUALITY_MIN_COVERAGE)
+    return AD013_CODE_FEATURE_FAIL_AMORPHOUS;
+
+  if (stats->dryness > AD013_QUALITY_MAX_DRYNESS)
+    return AD013_CODE_FEATURE_FAIL_LIGTH_DRY;
+
+  if (stats->wetness > AD013_QUALITY_MAX_WETNESS)
+    return AD013_CODE_FEATURE_FAIL_DARK_WET;
+
+  return AD013_CODE_OK;
+}
+
+                        // ==========================
+                        // Power Management Functions
+                        // ==========================
+
+void AD013_PowerSetIdleTimeout(unsigned long idleTimeout) {
+  AD013_Power.idleTimeout = idleTimeout;
+  AD013_Power.lastActive = millis();
+}
+
+void AD013_PowerTouch(void) {
+  // Safe to call from an ISR, the wake-up is done by AD013_PowerPoll()
+  AD013_Power.touched = 1;
+}
+
+bool AD013_PowerIsAsleep(void) {
+  return AD013_Power.state != AD013_POWER_AWAKE;
+}
+
+int AD013_PowerSleep(Stream & SensorCom) {
+
+  int code = -1;
+
+  if (AD013_Power.state != AD013_POWER_AWAKE) return 1;
+
+  // A finger is already on the sensor, no point in sleeping
+  if (AD013_Power.touched) return -1;
+
+  if ((code = PS_Sleep(SensorCom)) != AD013_CODE_OK) {
+    AD013_LOG_ERROR("Cannot Enter Low Power Mode (code: %d)", code);
+    return -1;
+  }
+
+  AD013_Power.state = AD013_POWER_ASLEEP;
+  AD013_Power.sleepStart = millis();
+  AD013_Power.stats.sleeps++;
+
+  return 1;
+}
+
+int AD013_PowerWake(Stream & SensorCom) {
+  return AD013_PowerWakeBy(SensorCom, AD013_DeadlineIn(AD013_POWER_WAKE_TIMEOUT));
+}
+
+int AD013_PowerWakeBy(Stream & SensorCom, unsigned long deadline) {
+
+  AD013_Params params = AD013_DefaultParams;
+  unsigned long start = millis();
+  unsigned long latency = 0;
+  long left = 0;
+  int code = -1;
+
+  if (AD013_Power.state != AD013_POWER_ASLEEP) return 1;
+
+  AD013_Power.state = AD013_POWER_WAKING;
+  if (AD013_Power.verified) {
+    params = AD013_Power.auth;
+  } else {
+    AD013_AddParamN(&params, AD013_def_passwd, sizeof(AD013_def_passwd));
+  }
+
+  // The module does not answer until it is up again, so the
+  // handshake is repeated (with a short timeout) until it does.
+  // Any valid ACK means it is up (even a password rejection)
+  do {
+    while (SensorCom.available()) SensorCom.read();
+    left = AD013_DeadlineLeft(deadline);
+    code = AD013_Send(0x13, SensorCom, &params, NULL, NULL,
+                      left < AD013_POWER_WAKE_RETRY ? (left > 0 ? left : 1) : AD013_POWER_WAKE_RETRY);
+  } while (code < 0 && !AD013_DeadlinePassed(deadline));
+
+  if (code < 0) {
+    AD013_LOG_ERROR("Cannot Wake Up the Module (code: %d)", code);
+    AD013_Power.state = AD013_POWER_ASLEEP;
+    return -1;
+  }
+
+  if (code != AD013_CODE_OK) {
+    AD013_LOG_WARN("Module Awake, Password not verified (code: %d)", code);
+  }
+
+  latency = millis() - start;
+
+  AD013_Power.stats.asleepMs += start - AD013_Power.sleepStart;
+  AD013_Power.stats.wakes++;
+  if (AD013_Power.touched) AD013_Power.stats.touchWakes++;
+  AD013_Power.stats.wakeLatency = latency;
+  if (latency > AD013_Power.stats.maxWakeLatency) AD013_Power.stats.maxWakeLatency = latency;
+
+  AD013_Power.touched = 0;
+  AD013_Power.state = AD013_POWER_AWAKE;
+  AD013_Power.lastActive = millis();
+
+  AD013_LOG_DEBUG("Module Awake (%lu ms)", latency);
+
+  return 1;
+}
+
+int AD013_PowerPoll(Stream & SensorCom) {
+
+  // Touch while asleep: the finger is there, wakes up now
+  if (AD013_Power.state == AD013_POWER_ASLEEP) {
+    return AD013_Power.touched ? AD013_PowerWake(SensorCom) : 1;
+  }
+
+  // Touch while awake (nothing to do but to restart the idle period)
+  if (AD013_Power.touched) {
+    AD013_Power.touched = 0;
+    AD013_Power.lastActive = millis();
+    return 1;
+  }
+
+  if (AD013_Power.idleTimeout == 0 ||
+      millis() - AD013_Power.lastActive < AD013_Power.idleTimeout) return 1;
+
+  return AD013_PowerSleep(SensorCom);
+}
+
+unsigned long AD013_PowerWakeLatency(void) {
+
+  if (AD013_Power.state == AD013_POWER_AWAKE) return 0;
+
+  // Not measured yet, assumes the worst
+  if (AD013_Power.stats.wakes == 0) return AD013_POWER_WAKE_TIMEOUT;
+
+  return AD013_Power.stats.maxWakeLatency;
+}
+
+void AD013_PowerGetStats(AD013_PowerStats * stats) {
+
+  if (!stats) return;
+
+  *stats = AD013_Power.stats;
+
+  // Includes the current sleep period
+  if (AD013_Power.state != AD013_POWER_AWAKE) {
+    stats->asleepMs += millis() - AD013_Power.sleepStart;
+  }
+}
+
+                        // =====================
+                        // LED Control Functions
+                        // =====================
+
+int AD013_LedParams(AD013_Params * params,
+                    int            mode,
+                    int            color,
+                    int            endColor,
+                    int            cycles) {
+
+  if (!params || mode < AD013_LED_BREATHE || mode > AD013_LED_FADE_OUT) return -1;
+  if (cycles < 0 || cycles > 255) return -1;
+
+  if (endColor < 0) endColor = color;
+
+  AD013_ClearParams(params);
+  AD013_AddParam1(params, mode);     // Function (1 byte)
+  AD013_AddParam1(params, color);    // Start Color (1 byte)
+  AD013_AddParam1(params, endColor); // End Color (1 byte)
+  AD013_AddParam1(params, cycles);   // Cycles (1 byte, 0: forever)
+
+  return 1;
+}
+
+int AD013_SetLed(Stream & SensorCom,
+                 int      mode,
+                 int      color,
+                 int      endColor,
+                 int      cycles) {
+
+  AD013_Params params = AD013_DefaultParams;
+  int code = -1;
+
+  if (AD013_LedParams(&params, mode, color, endColor, cycles) < 0) return -1;
+
+  if ((code = PS_ControlBLN(SensorCom, &params)) != AD013_CODE_OK) {
+    AD013_LOG_ERROR("Cannot Set LED (code: %d)", code);
+    return -1;
+  }
+
+  return 1;
 }
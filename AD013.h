@@ -1,9 +1,305 @@
 #ifndef AD013_FINGERPRINT_SENSOR_HEADER
 #define AD013_FINGERPRINT_SENSOR_HEADER
 
+#include <Arduino.h>
+
+// SoftwareSerial (if the core provides it)
+#if defined(__has_include)
+#if __has_include(<SoftwareSerial.h>)
+#include <SoftwareSerial.h>
+#define AD013_HAS_SOFTWARE_SERIAL  1
+#endif
+#endif
+
 // Use different max sizes if needed
 #define AD013_MAX_PARAMS_SIZE     20
 
+// Protocol Definitions
+#define AD013_MSG_HEADER_SIZE     10
+#define AD013_MAX_CMD_SIZE        (AD013_MSG_HEADER_SIZE + AD013_MAX_PARAMS_SIZE + 2)
+
+// Message Offsets
+#define AD013_MSG_OFFSET_HEADER    0
+#define AD013_MSG_OFFSET_DEVID     2
+#define AD013_MSG_OFFSET_FLAG      6
+#define AD013_MSG_OFFSET_LENGTH    7
+#define AD013_MSG_OFFSET_CODE      9
+#define AD013_MSG_OFFSET_DATA     10
+
+// Packet Identifiers (Flag)
+#define AD013_PKT_FLAG_COMMAND     0x01
+#define AD013_PKT_FLAG_DATA        0x02
+#define AD013_PKT_FLAG_ACK         0x07
+#define AD013_PKT_FLAG_DATA_END    0x08
+
+// Host (POSIX) builds, e.g. Linux gateways using the Arduino API
+#if defined(__unix__) || defined(__APPLE__)
+#define AD013_HOST_BUILD           1
+#endif
+
+// Largest Data Packet the library can receive (32, 64, 128 or 256)
+#ifndef AD013_MAX_PACKET_SIZE
+#ifdef AD013_HOST_BUILD
+#define AD013_MAX_PACKET_SIZE    256
+#else
+#define AD013_MAX_PACKET_SIZE    128
+#endif
+#endif
+
+// Fingerprint DB Layout (Templates 0-19 are reserved for the SO)
+#ifndef AD013_MAX_TEMPLATES
+#define AD013_MAX_TEMPLATES       40
+#endif
+#define AD013_SO_TEMPLATES        20
+
+// Slots tracked by the Template Cache (lower it to save RAM)
+#ifndef AD013_TEMPLATE_CACHE_SIZE
+#define AD013_TEMPLATE_CACHE_SIZE AD013_MAX_TEMPLATES
+#endif
+
+// Recent Matches remembered by AD013_SearchTemplate() (0 disables it).
+// When enabled, every successful search uploads the Char once to hash
+// it, and cache hits are confirmed with PS_Match (see AD013_CharHash)
+#ifndef AD013_MATCH_CACHE_SIZE
+#define AD013_MATCH_CACHE_SIZE     0
+#endif
+#ifndef AD013_MATCH_CACHE_TTL
+#define AD013_MATCH_CACHE_TTL   5000 /* Re-presentation Window (ms) */
+#endif
+#ifndef AD013_MATCH_CACHE_MAX_DIST
+#define AD013_MATCH_CACHE_MAX_DIST 3 /* Max. Different Bits between Char Hashes */
+#endif
+
+// Worst-case Stage Durations planned by AD013_SearchTemplateWithin()
+#ifndef AD013_BOUND_EXTRACT_MS
+#define AD013_BOUND_EXTRACT_MS   500 /* PS_GenChar */
+#endif
+#ifndef AD013_BOUND_SEARCH_MS
+#define AD013_BOUND_SEARCH_MS     50 /* PS_Search (fixed part) */
+#endif
+#ifndef AD013_BOUND_TEMPLATE_MS
+#define AD013_BOUND_TEMPLATE_MS    5 /* PS_Search (per Template) */
+#endif
+
+// Match Score Histogram (see AD013_ScoreStatsGet)
+#ifndef AD013_SCORE_BUCKETS
+#define AD013_SCORE_BUCKETS       16
+#endif
+#ifndef AD013_SCORE_BUCKET_WIDTH
+#define AD013_SCORE_BUCKET_WIDTH  16 /* The last bucket holds all higher scores */
+#endif
+#ifndef AD013_SCORE_STATS_TEMPLATES
+#define AD013_SCORE_STATS_TEMPLATES AD013_MAX_TEMPLATES
+#endif
+
+// Bytes of occupancy bitmap per Index Table page
+#define AD013_INDEX_PAGE_SIZE     32
+
+#define AD013_IndexTableIsUsed(bitmap, id) \
+  (((bitmap)[(id) >> 3] >> ((id) & 0x07)) & 0x01)
+
+// Max size of a Template (UpChar/DownChar)
+#ifndef AD013_TEMPLATE_MAX_SIZE
+#define AD013_TEMPLATE_MAX_SIZE 2048
+#endif
+
+// Image Quality Thresholds (see AD013_ImageQuality)
+#ifndef AD013_QUALITY_BLOCK_SIZE
+#define AD013_QUALITY_BLOCK_SIZE       8 /* Block Size (pixels) */
+#endif
+#ifndef AD013_QUALITY_RIDGE_GRADIENT
+#define AD013_QUALITY_RIDGE_GRADIENT  12 /* Min Avg Gradient of Ridge Blocks */
+#endif
+#ifndef AD013_QUALITY_LIGHT_LEVEL
+#define AD013_QUALITY_LIGHT_LEVEL    192 /* Light (Valley/Dry) Pixels */
+#endif
+#ifndef AD013_QUALITY_DARK_LEVEL
+#define AD013_QUALITY_DARK_LEVEL      64 /* Dark (Ridge/Wet) Pixels */
+#endif
+#ifndef AD013_QUALITY_MIN_CONTRAST
+#define AD013_QUALITY_MIN_CONTRAST    48
+#endif
+#ifndef AD013_QUALITY_MIN_COVERAGE
+#define AD013_QUALITY_MIN_COVERAGE    40 /* Percent of Blocks */
+#endif
+#ifndef AD013_QUALITY_MAX_DRYNESS
+#define AD013_QUALITY_MAX_DRYNESS     60 /* Percent of Ridge Area */
+#endif
+#ifndef AD013_QUALITY_MAX_WETNESS
+#define AD013_QUALITY_MAX_WETNESS     60 /* Percent of Ridge Area */
+#endif
+
+// Enrollment (see AD013_Enroll)
+#ifndef AD013_ENROLL_SAMPLES
+#define AD013_ENROLL_SAMPLES         5 /* Chars merged into a Template (Char Buffers 1-N) */
+#endif
+#ifndef AD013_ENROLL_RETRIES
+#define AD013_ENROLL_RETRIES         3 /* Extra Captures allowed per Sample */
+#endif
+#ifndef AD013_ENROLL_TIMEOUT
+#define AD013_ENROLL_TIMEOUT     10000 /* Time allowed for each Finger Placement (ms) */
+#endif
+#ifndef AD013_ENROLL_MIN_SHIFT
+#define AD013_ENROLL_MIN_SHIFT       8 /* Min. Finger Move between Samples (percent) */
+#endif
+
+// Power Management (see AD013_PowerPoll)
+#ifndef AD013_POWER_IDLE_TIMEOUT
+#define AD013_POWER_IDLE_TIMEOUT   10000 /* Idle Time before Sleeping (ms, 0: never) */
+#endif
+#ifndef AD013_POWER_WAKE_TIMEOUT
+#define AD013_POWER_WAKE_TIMEOUT     500 /* Time allowed for the module to wake up (ms) */
+#endif
+#ifndef AD013_POWER_WAKE_RETRY
+#define AD013_POWER_WAKE_RETRY        50 /* Handshake Period while waking up (ms) */
+#endif
+
+// Warm Start (see AD013_FindSensorWarm)
+#ifndef AD013_WARM_PROBE_TIMEOUT
+#define AD013_WARM_PROBE_TIMEOUT     100 /* Liveness Probe Timeout (ms) */
+#endif
+
+// RAM left untouched by resets (holds the cached session)
+#ifndef AD013_NOINIT
+#if defined(ESP32)
+#define AD013_NOINIT               RTC_NOINIT_ATTR
+#elif defined(__AVR__) || defined(__arm__)
+#define AD013_NOINIT               __attribute__((section(".noinit")))
+#else
+#define AD013_NOINIT
+#endif
+#endif
+
+// LED Modes (PS_ControlBLN), run by the module itself
+#define AD013_LED_BREATHE          1 /* Breathes from color to endColor */
+#define AD013_LED_FLASH            2
+#define AD013_LED_ON               3
+#define AD013_LED_OFF              4
+#define AD013_LED_FADE_IN          5
+#define AD013_LED_FADE_OUT         6
+
+// LED Colors (can be combined)
+#define AD013_LED_BLUE          0x01
+#define AD013_LED_GREEN         0x02
+#define AD013_LED_RED           0x04
+
+typedef enum {
+  AD013_CODE_OK                     = 0x00,
+  AD013_CODE_ERROR                  = 0x01,
+  AD013_CODE_NO_FINGER              = 0x02,
+  AD013_CODE_IMAGE_FAIL             = 0x03,
+  AD013_CODE_FEATURE_FAIL_LIGTH_DRY = 0x04,
+  AD013_CODE_FEATURE_FAIL_DARK_WET  = 0x05,
+  AD013_CODE_FEATURE_FAIL_AMORPHOUS = 0x06,
+  AD013_CODE_FEATURE_FAIL_MINUTIAE  = 0x07,
+  AD013_CODE_FINGER_NOT_MATCHED     = 0x08,
+  AD013_CODE_FINGER_NOT_FOUND       = 0x09,
+  AD013_CODE_FEATURE_FAIL_MERGE     = 0x0A,
+  AD013_CODE_TEMLATE_DB_RANGE_ERROR = 0x0B,
+  AD013_CODE_TEMPLATE_READ_ERROR    = 0x0C,
+  AD013_CODE_FEATURE_UPLOAD_FAIL    = 0x0D,
+  AD013_CODE_DATA_RECEIVE_ERROR     = 0x0E,
+  AD013_CODE_DATA_IMAGE_UPLOAD_FAIL = 0x0F,
+  AD013_CODE_DELETE_FAIL            = 0x10,
+  AD013_CODE_TEMPLATE_DB_CLEAR_FAIL = 0x11,
+  AD013_CODE_LOW_POWER_MODE_ERROR   = 0x12,
+  AD013_CODE_PASSWORD_ERROR         = 0x13,
+  AD013_CODE_RESET_FAIL             = 0x14,
+  AD013_CODE_IMAGE_INCOMPLETE_ERROR = 0x15,
+  AD013_CODE_ONLINE_UPGRADE_FAIL    = 0x16,
+  AD013_CODE_IMAGE_STILL_DATA_ERROR = 0x17,
+  AD013_CODE_FLASH_READ_WRITE_ERROR = 0x18,
+  AD013_CODE_GENERIC_ERROR          = 0x19,
+  AD013_CODE_DATA_RECEIVED_OK       = 0xF0, /* Ack with 0xF0 after receiving data correctly */
+  AD013_CODE_DATA_CONTINUE_ACK      = 0xF1,
+  AD013_CODE_FLASH_SUM_ERROR        = 0xF2,
+  AD013_CODE_FLASH_FLAG_ERROR       = 0xF3,
+  AD013_CODE_FLASH_PKT_LENGTH_ERROR = 0xF4,
+  AD013_CODE_FLASH_CODE_TOO_LONG    = 0xF5,
+  AD013_CODE_FLASH_ERROR            = 0xF6,
+  AD013_CODE_REGISTER_NUMBER_ERROR  = 0x1A,
+  AD013_CODE_REGISTER_WRONG_DISTRO_NUMBER = 0x1B,
+  AD013_CODE_NOTEPAD_PAGE_NUMBER_ERROR = 0x1C,
+  AD013_CODE_PORT_OP_FAIL           = 0x1D,
+  AD013_CODE_AUTO_ENROLL_FAIL       = 0x1E,
+  AD013_CODE_TEMPLATE_DB_FULL       = 0x1F
+  /* 0x20 - 0xEF Reserved Values */
+} AD013_CODE;
+
+// Image Quality Metrics
+typedef struct image_stats_st {
+  uint8_t mean;      /* Mean Gray Level */
+  uint8_t contrast;  /* Spread between the 5th and 95th percentiles */
+  uint8_t coverage;  /* Blocks with Ridge Structure (percent) */
+  uint8_t dryness;   /* Light Pixels in the Ridge Area (percent) */
+  uint8_t wetness;   /* Dark Pixels in the Ridge Area (percent) */
+  uint8_t centerX;   /* Center of the Ridge Area (percent of the width) */
+  uint8_t centerY;   /* Center of the Ridge Area (percent of the height) */
+} AD013_ImageStats;
+
+// Search Outcome (see AD013_SearchTemplate)
+typedef enum {
+  AD013_SEARCH_OK        = 0, /* Matched */
+  AD013_SEARCH_NOT_FOUND = 1, /* Finger not in the DB */
+  AD013_SEARCH_TIMEOUT   = 2, /* No Finger before the timeout */
+  AD013_SEARCH_BAD_IMAGE = 3, /* Capture or Char failed (present the finger again) */
+  AD013_SEARCH_IO_ERROR  = 4, /* Sensor not answering or protocol error */
+  AD013_SEARCH_LOW_SCORE = 5, /* Matched below the threshold (rejected) */
+  AD013_SEARCH_DEADLINE  = 6  /* Budget over before a complete answer */
+} AD013_SEARCH_STATUS;
+
+// Search Result
+typedef struct search_result_st {
+  int           templateId;  /* Matched Template (-1: none, candidate if rejected) */
+  int           score;       /* Match Score */
+  int           status;      /* AD013_SEARCH_STATUS */
+  int           code;        /* Last Confirmation Code (or -1) */
+  int           attempts;    /* PS_GetImage Captures */
+  bool          cached;      /* Matched via the Match Cache */
+  int           searched;    /* Templates searched (from 0) */
+  unsigned long wakeMs;      /* Stage Timings (ms) */
+  unsigned long captureMs;
+  unsigned long extractMs;   /* PS_GenChar */
+  unsigned long searchMs;    /* PS_Search (or Match Cache) */
+} AD013_SearchResult;
+
+// Match Scores of a Template
+typedef struct template_scores_st {
+  uint16_t accepted;   /* Matches at or above the threshold */
+  uint16_t rejected;   /* Matches below the threshold */
+  uint16_t minScore;   /* Lowest Score seen */
+  uint16_t maxScore;   /* Highest Score seen */
+  uint32_t sum;        /* Sum of the Scores (for the mean) */
+} AD013_TemplateScores;
+
+// Match Score Statistics (fixed buckets of AD013_SCORE_BUCKET_WIDTH)
+typedef struct score_stats_st {
+  uint16_t             accepted[AD013_SCORE_BUCKETS];
+  uint16_t             rejected[AD013_SCORE_BUCKETS];
+  uint16_t             notFound;   /* Searches without candidates */
+  AD013_TemplateScores templates[AD013_SCORE_STATS_TEMPLATES];
+} AD013_ScoreStats;
+
+// Enrollment Sample (see AD013_Enroll)
+typedef struct enroll_sample_st {
+  int                      index;      /* Sample (0 to AD013_ENROLL_SAMPLES - 1) */
+  int                      attempt;    /* Capture for this Sample (0 is the first) */
+  int                      code;       /* PS_GenChar (or predicted) Confirmation Code */
+  bool                     duplicate;  /* Finger not moved since an earlier Sample */
+  bool                     accepted;
+  const AD013_ImageStats * stats;      /* Image Metrics (NULL without image) */
+} AD013_EnrollSample;
+
+// Power Management Counters
+typedef struct power_stats_st {
+  unsigned long sleeps;          /* Accepted Sleep Commands */
+  unsigned long wakes;           /* Wake-ups (touch and API) */
+  unsigned long touchWakes;      /* Wake-ups started by a touch */
+  unsigned long asleepMs;        /* Total Time Asleep (ms) */
+  unsigned long wakeLatency;     /* Last Wake-up Latency (ms) */
+  unsigned long maxWakeLatency;  /* Worst Wake-up Latency (ms) */
+} AD013_PowerStats;
+
 // Static Parameters Buffer
 typedef struct params_st {
   char buff[AD013_MAX_PARAMS_SIZE];
@@ -11,6 +307,70 @@ typedef struct params_st {
   int size;
 } AD013_Params;
 
+// Sensor's System Parameters
+typedef struct sys_params_st {
+  uint16_t status;        /* Status Register */
+  uint16_t sensorType;
+  uint16_t capacity;      /* Fingerprint DB Size */
+  uint16_t securityLevel;
+  char     devId[4];
+  uint16_t packetSize;    /* Data Packet Size (bytes) */
+  long     baud;
+} AD013_SysParams;
+
+/*! \brief Receives the data packets of multi-packet transfers
+ *
+ * The sink is called once per received data packet with the
+ * payload of the packet (data and data_len) and the ctx pointer
+ * passed by the caller. The data pointer is only valid for the
+ * duration of the call.
+ *
+ * Return a negative value to abort the transfer (the remaining
+ * packets are still drained from the Stream). The Stream is also
+ * drained when the transfer itself fails (timeout, bad packet).
+ */
+typedef int (*AD013_DataSink)(const byte * data, int data_len, void * ctx);
+
+
+/*! \brief Receives the outcome of each enrollment capture
+ *
+ * Use it to guide the user (e.g., "lift your finger", "move it a bit")
+ * as the samples are taken. Return a negative value to abort the
+ * enrollment.
+ */
+typedef int (*AD013_EnrollFunc)(const AD013_EnrollSample * sample, void * ctx);
+
+
+/*! \brief Re-opens a port at a different speed
+ *
+ * The function is called with the port pointer of the Baud Control
+ * and the requested baud. It must return 1 once the port runs at the
+ * new speed and -1 if the speed cannot be set.
+ */
+typedef int (*AD013_BaudFunc)(void * port, long baud);
+
+// Port Speed Control (see AD013_HardwareSerialBaud() and friends)
+typedef struct baud_control_st {
+  AD013_BaudFunc begin;   /* Re-opens the port at a given baud */
+  void         * port;    /* Port handed to begin() */
+} AD013_BaudControl;
+
+
+#ifndef AD013_HOST_BUILD
+/*! \brief Returns a Baud Control for a HardwareSerial port */
+AD013_BaudControl AD013_HardwareSerialBaud(HardwareSerial & port);
+#endif
+
+#ifdef AD013_HAS_SOFTWARE_SERIAL
+/*! \brief Returns a Baud Control for a SoftwareSerial port */
+AD013_BaudControl AD013_SoftwareSerialBaud(SoftwareSerial & port);
+#endif
+
+#ifdef AD013_HOST_BUILD
+/*! \brief Returns a Baud Control for a POSIX tty (open file descriptor) */
+AD013_BaudControl AD013_TtyBaud(int fd);
+#endif
+
 
 /*! \brief Establishes a connection with the sensor
  * 
@@ -28,6 +388,13 @@ typedef struct params_st {
  * The default for the serSpeed is -1 (scan for the correct
  * speed/baud).
  * 
+ * The port speed is changed through baudCtl (e.g., use
+ * AD013_HardwareSerialBaud(Serial1)). HardwareSerial and
+ * SoftwareSerial ports passed directly use their own Baud
+ * Control, so they are scanned as before. For any other
+ * Stream without a Baud Control, the port is used at its
+ * current speed and no scan is done.
+ * 
  * The default for mySerial is Serial1 (if it exists) or
  * Serial (if it exists). If none exist, an error code is
  * returned.
@@ -37,39 +404,204 @@ typedef struct params_st {
  * returns negative values for error conditions.
  * 
  */
-int AD013_FindSensor(Stream     & mySerial,
-                   int          serSpeed = -1,
-                   AD013_Params * params   = NULL);
+int AD013_FindSensor(Stream            & mySerial,
+                     int                 serSpeed = -1,
+                     AD013_Params      * params   = NULL,
+                     AD013_BaudControl * baudCtl  = NULL);
+
+#ifndef AD013_HOST_BUILD
+int AD013_FindSensor(HardwareSerial    & mySerial,
+                     int                 serSpeed = -1,
+                     AD013_Params      * params   = NULL);
+#endif
+
+#ifdef AD013_HAS_SOFTWARE_SERIAL
+int AD013_FindSensor(SoftwareSerial    & mySerial,
+                     int                 serSpeed = -1,
+                     AD013_Params      * params   = NULL);
+#endif
+
+/*! \brief Finds the sensor, reusing the session cached before a reset
+ *
+ * Use this function instead of AD013_FindSensor() on controllers that
+ * can reset (e.g., brown-outs or watchdogs) while the sensor stays
+ * powered. The link (baud and device address) found by the last full
+ * handshake is kept in AD013_NOINIT RAM: after a reset the port is set
+ * back to its speed and a single PS_ReadSysPara (liveness probe, with
+ * AD013_WARM_PROBE_TIMEOUT) checks the sensor is still there, without
+ * the password verification and the baud scan.
+ *
+ * If there is no valid session (e.g., power-on) or the probe fails, the
+ * full AD013_FindSensor() handshake is done (same parameters) and its
+ * outcome is cached for the next reset. Either way the sensor's data
+ * packet size is picked up as with AD013_GetPacketSize().
+ *
+ * The function returns 1 if the sensor has been found and -1 otherwise.
+ */
+int AD013_FindSensorWarm(Stream            & mySerial,
+                         int                 serSpeed = -1,
+                         AD013_Params      * params   = NULL,
+                         AD013_BaudControl * baudCtl  = NULL);
+
+#ifndef AD013_HOST_BUILD
+int AD013_FindSensorWarm(HardwareSerial    & mySerial,
+                         int                 serSpeed = -1,
+                         AD013_Params      * params   = NULL);
+#endif
+
+#ifdef AD013_HAS_SOFTWARE_SERIAL
+int AD013_FindSensorWarm(SoftwareSerial    & mySerial,
+                         int                 serSpeed = -1,
+                         AD013_Params      * params   = NULL);
+#endif
+
+/*! \brief Drops the cached session (see AD013_FindSensorWarm)
+ *
+ * Use this function when the sensor is power cycled or replaced, so that
+ * the next AD013_FindSensorWarm() does the full handshake.
+ */
+void AD013_SessionClear(void);
+
+
+/*! \brief Sends a command without waiting for the reply
+ *
+ * Use this function with non-blocking transports: the command packet is
+ * written to the port and the function returns immediately. The reply
+ * (ACK) has to be collected with the frame parser (see AD013_Transport.h).
+ *
+ * The function returns the number of bytes written or -1 if any error
+ * occurs.
+ */
+int AD013_SendCmd(Print        & SerialPort,
+                  int            code,
+                  AD013_Params * params = NULL);
+
+
+/*! \brief Computes the 16-bit additive checksum of a buffer
+ *
+ * The checksum of a packet covers the Flag, the Length and the Code/Data
+ * fields. Use sum to continue a checksum over multiple buffers.
+ */
+uint16_t AD013_Sum(uint16_t sum, const byte * data, int data_len);
+
+/*! \brief Copies a buffer and adds its bytes to a 16-bit checksum
+ *
+ * Same as AD013_Sum() over src, the bytes are also copied into dst so
+ * that received data is touched only once.
+ */
+uint16_t AD013_CopySum(uint16_t sum, byte * dst, const byte * src, int len);
+
+
+/*! \brief Reads the sensor's system parameters
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_ReadSysParams(Stream          & SerialPort,
+                        AD013_SysParams * sysParams);
+
+
+/*! \brief Switches the sensor (and the port) to a different baud rate
+ *
+ * Use this function, after AD013_FindSensor(), to raise the link speed
+ * (e.g., to 115200) for faster Template and Image transfers. The baud
+ * must be a multiple of 9600 (up to 115200).
+ *
+ * The new rate is written into the sensor's baud rate register, then the
+ * port is re-opened at the new rate (through baudCtl) and the link is checked with the
+ * password verification (use params as for AD013_FindSensor()). If the
+ * check fails, both the port and the sensor are rolled back to the
+ * previous rate.
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_SetBaudRate(Stream            & SerialPort,
+                      AD013_BaudControl * baudCtl,
+                      long                baud,
+                      AD013_Params      * params = NULL);
+
+
+/*! \brief Reads the sensor's data packet size
+ *
+ * Use this function after AD013_FindSensor() when the sensor might not
+ * use the default size (128 bytes). The library uses the returned size
+ * for the data packets it sends (AD013_DownChar()). A size larger than
+ * AD013_MAX_PACKET_SIZE (which could not be received) is lowered in the
+ * sensor first; if that fails, -1 is returned.
+ *
+ * The function returns the packet size (32, 64, 128 or 256) or -1 if any
+ * error occurs.
+ */
+int AD013_GetPacketSize(Stream & SerialPort);
+
+/*! \brief Sets the sensor's data packet size
+ *
+ * Use this function to raise the data packet size for bulk transfers
+ * (fewer headers and checksums per Template or Image). The largest size
+ * not exceeding maxSize (the transport's buffers) and the library's
+ * AD013_MAX_PACKET_SIZE is selected. Use -1 for AD013_MAX_PACKET_SIZE.
+ *
+ * The function returns the selected packet size or -1 if any error
+ * occurs.
+ */
+int AD013_SetPacketSize(Stream & SerialPort, int maxSize = -1);
 
 
 /*
  * !\brief Searches for a Match in the Fingerprint Database
  * 
- * This function searches for a match in the Fingerprint Database and
- * returned the matched template. This function returns '-1' if no
- * templates were matched.
+ * This function captures a finger, generates its Char (Char Buffer 1)
+ * and searches the Fingerprint Database for it. The outcome is detailed
+ * in result (if not NULL): the matched Template and its score, the
+ * status (AD013_SEARCH_*), the number of captures and the time taken by
+ * each stage.
  * 
- * The default timeout is 5000 ms.
+ * The default timeout (for the finger to be placed) is 5000 ms.
  * 
- * The default threashold is 65.
- * 
- * The default SerialPort is (Serial1) if present, or (Serial) if present.
+ * The default threashold is 50: matches scoring less are rejected
+ * (AD013_SEARCH_LOW_SCORE). Every score is recorded in the Score
+ * Statistics (see AD013_ScoreStatsGet()) to help choosing it.
  * 
  * The default for SecurityOfficerOnly is (false). Use True to limit the
  * matching operations to the first twenty (0-19) Templates ID (usually
  * reserved for the Security Officer).
  * 
+ * The function returns the ID of the matched template, or -1 if no
+ * templates were matched or an error occurred (see result->status).
+ */
+int AD013_SearchTemplate (Stream             & SerialPort,
+                          int                  timeOut             = 5000,
+                          int                  threashold          = 50,
+                          bool                 SecurityOfficerOnly = false,
+                          AD013_SearchResult * result              = NULL);
+
+/*
+ * !\brief Searches for a Match within a hard time budget
+ * 
+ * Same as AD013_SearchTemplate(), but the whole call (wake-up, capture,
+ * Char generation and search) is bounded by budget (ms). Every command
+ * gets at most the time left and, using the AD013_BOUND_* estimates,
+ * the capture stops early enough for the search to fit. When the budget
+ * runs short the search only covers the first result->searched
+ * Templates (the SO's come first). The Match Cache is not used.
+ * 
+ * When no complete answer fits in the budget, result->status is set to
+ * AD013_SEARCH_DEADLINE (AD013_SEARCH_TIMEOUT if no finger was placed).
+ * 
+ * The function returns the ID of the matched template, or -1 if no
+ * templates were matched or an error occurred (see result->status).
  */
-int AD013_SearchTemplate (int      timeOut             = 5000,
-                        int      threashold          = 50,
-                        Stream * SerialPort          = NULL,
-                        bool     SecurityOfficerOnly = false);
+int AD013_SearchTemplateWithin (Stream             & SerialPort,
+                                unsigned long        budget,
+                                int                  threashold          = 50,
+                                bool                 SecurityOfficerOnly = false,
+                                AD013_SearchResult * result              = NULL);
 
 
 /* !\brief Clears one template from the fingerprint DB
  *  
- * Use this function to remove a single template. The templateNumber parameter
- * provides the number of the template to be removed (0-39).
+ * Use this function to remove a range of templates. The startTemplateNumber
+ * and endTemplateNumber parameters provide the (inclusive) range of templates
+ * to be removed (0-39) with a single command.
  * 
  * The default SerialPort is (Serial1) if present, or (Serial) if present.
  * 
@@ -101,16 +633,380 @@ int AD013_ClearUserTemplates(Stream & SerialPort);
  */
 int AD013_ClearSecurityOfficerTemplates(Stream & SerialPort);
 
+/* !\brief Reads the occupancy bitmap of the fingerprint DB
+ *
+ * Use this function to find out which Template IDs are in use. Bit (id % 8)
+ * of bitmap[id / 8] is set when the Template id is stored (use the
+ * AD013_IndexTableIsUsed() macro). One Index Table page is read for every
+ * AD013_INDEX_PAGE_SIZE bytes of bitmap_len.
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_ReadIndexTable(Stream & SerialPort,
+                         byte   * bitmap,
+                         int      bitmap_len);
+
 
 /* !\brief Enrolls a new Finger in the Sensor's DB
  *  
  * Use this function to generate and store a new Template (5 different chars
  * compose a single Template; The AD-013 can store up to 40 Templates).
+ *
+ * Each sample is checked as soon as it is captured, so that a bad one is
+ * retaken on the spot (up to AD013_ENROLL_RETRIES times) instead of
+ * failing the merge at the end. The finger has to be lifted between
+ * captures. When img is provided (width x height bytes), each image is
+ * uploaded and checked with AD013_ImageQuality() before PS_GenChar, and
+ * samples taken without moving the finger (AD013_ENROLL_MIN_SHIFT) are
+ * rejected as near-duplicates. The feedback function (if any) is called
+ * after every capture.
+ *
+ * The new Template is stored in the first free slot of the user's (or
+ * the Security Officer's) range. Fingers that are already enrolled are
+ * not stored twice: the first sample is searched for (one PS_Search over
+ * the occupied slots) and, if found, the enrollment stops there and the
+ * existing ID is returned (enrolled, if not NULL, is set to false). If
+ * the search itself fails, the enrollment is aborted.
  * 
  * The function returns the ID of the storage buffer where the new Template
  * has successfully been saved. In case of errors, the function returns -1.
  *
  */
-int AD013_Enroll(Stream & SerialPort, bool isSecurityOfficer);
+int AD013_Enroll(Stream         & SerialPort,
+                 bool             isSecurityOfficer,
+                 AD013_EnrollFunc feedback = NULL,
+                 void           * ctx      = NULL,
+                 byte           * img      = NULL,
+                 int              width    = 0,
+                 int              height   = 0,
+                 bool           * enrolled = NULL);
+
+
+/* !\brief Uploads the last captured image from the sensor
+ *
+ * Use this function after a successful image capture (PS_GetImage)
+ * to retrieve the raw image from the sensor's image buffer. The
+ * image is sent by the sensor as a sequence of data packets.
+ *
+ * When buff is provided, the payload of each packet is read from
+ * the SerialPort directly into buff (no intermediate copies). The
+ * transfer fails if the image does not fit into buff_len bytes.
+ *
+ * When buff is NULL, each packet is handed to the sink (one call
+ * per packet) instead. This is useful when the image does not fit
+ * into RAM or needs to be forwarded as it arrives.
+ *
+ * The function returns the number of image bytes received. In case
+ * of errors, the function returns -1 (-99 for checksum errors).
+ */
+long AD013_UpImage(Stream       & SerialPort,
+                   byte         * buff,
+                   long           buff_len,
+                   AD013_DataSink sink = NULL,
+                   void         * ctx  = NULL);
+
+
+/* !\brief Loads a stored Template into a Char Buffer
+ *
+ * Use this function to copy the Template stored at templateId into
+ * the sensor's Char Buffer bufferId (e.g., before AD013_UpChar()).
+ *
+ * The function returns 1 in case of success, 0 if no Template is stored
+ * at templateId and -1 if any other error occurs.
+ */
+int AD013_LoadTemplate(Stream & SerialPort,
+                       int      templateId,
+                       int      bufferId = 1);
+
+/* !\brief Stores a Char Buffer as a Template
+ *
+ * Use this function to store the sensor's Char Buffer bufferId into
+ * the fingerprint DB at templateId (e.g., after AD013_DownChar()).
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_StoreTemplate(Stream & SerialPort,
+                        int      bufferId,
+                        int      templateId);
+
+/* !\brief Uploads the contents of a Char Buffer from the sensor
+ *
+ * Use this function to retrieve a Char/Template from the sensor's Char
+ * Buffer bufferId. As with AD013_UpImage(), the data is read directly
+ * into buff (up to buff_len bytes) or handed to the sink packet by
+ * packet when buff is NULL.
+ *
+ * The function returns the number of bytes received. In case of errors,
+ * the function returns -1 (-99 for checksum errors).
+ */
+long AD013_UpChar(Stream       & SerialPort,
+                  int            bufferId,
+                  byte         * buff,
+                  long           buff_len,
+                  AD013_DataSink sink = NULL,
+                  void         * ctx  = NULL);
+
+/* !\brief Downloads a Template into a Char Buffer of the sensor
+ *
+ * Use this function to send a Char/Template (e.g., retrieved earlier
+ * via AD013_UpChar()) to the sensor's Char Buffer bufferId. The data
+ * is sent directly from buff.
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_DownChar(Stream     & SerialPort,
+                   int          bufferId,
+                   const byte * buff,
+                   long         buff_len);
+
+
+/* !\brief Fetches a stored Template unless known to be unchanged
+ *
+ * Use this function for backups and audits. The Template stored at
+ * templateId is fetched (PS_LoadChar + PS_UpChar via Char Buffer 1) into
+ * buff and its hash is recorded in the Template Cache. When the cache
+ * knows the slot did not change since the last fetch, nothing is sent
+ * to the sensor (unless force is true).
+ *
+ * The function returns the number of bytes fetched, 0 if the fetch was
+ * skipped (use AD013_TemplateCacheGet() for the known hash), and -1 if
+ * any error occurs.
+ */
+long AD013_FetchTemplate(Stream & SerialPort,
+                         int      templateId,
+                         byte   * buff,
+                         long     buff_len,
+                         bool     force = false);
+
+/* !\brief Returns the known hash (CRC32) of a stored Template
+ *
+ * The Template Cache tracks, for each slot, the hash of the contents
+ * last fetched from (or recorded for) the slot and a generation counter
+ * that the library bumps every time it stores to or deletes from the
+ * slot. Hashes from older generations are stale.
+ *
+ * The function returns 0 if the hash is unknown or stale.
+ */
+uint32_t AD013_TemplateCacheGet(int templateId);
+
+/* !\brief Records the hash (CRC32) of the Template stored in a slot
+ *
+ * Use this function after storing a Template whose hash is known (e.g.,
+ * AD013_DownChar() + AD013_StoreTemplate()) to avoid fetching it later.
+ */
+void AD013_TemplateCacheSet(int templateId, uint32_t hash);
+
+/* !\brief Returns the generation counter of a slot */
+uint8_t AD013_TemplateCacheGeneration(int templateId);
+
+/* !\brief Marks the slots startId-endId as changed
+ *
+ * The library calls this function for its own stores and deletes. Use
+ * it when storing to or deleting from the sensor's DB through other
+ * transports (e.g., PS_StoreChar on a reactor device), so that the stale
+ * hashes and cached matches of the slots are dropped.
+ */
+void AD013_TemplateCacheBump(int startId, int endId);
+
+/* !\brief Forgets all the hashes in the Template Cache
+ *
+ * Use this function when the sensor's DB might have been modified by
+ * someone else (e.g., after swapping the sensor).
+ */
+void AD013_TemplateCacheReset(void);
+
+/* !\brief Computes the CRC32 of a buffer (used for Template hashes) */
+uint32_t AD013_Crc32(uint32_t crc, const byte * data, long data_len);
+
+
+/* !\brief Computes the similarity hash (SimHash) of a Char
+ *
+ * Near-identical Chars (e.g., two presentations of the same finger a
+ * few seconds apart) get hashes that differ in a few bits only, see
+ * AD013_MatchCacheLookup(). Unrelated Chars can collide (e.g., mostly
+ * padding), so the hash only picks a candidate: AD013_SearchTemplate()
+ * confirms it with a one-to-one PS_Match before accepting it.
+ */
+uint32_t AD013_CharHash(const byte * data, long data_len);
+
+/* !\brief Looks for a recent match of a Char (by its AD013_CharHash())
+ *
+ * Matches older than AD013_MATCH_CACHE_TTL are ignored. A cached match
+ * is found when the hashes differ in up to AD013_MATCH_CACHE_MAX_DIST
+ * bits; its score is returned in score (if not NULL).
+ *
+ * The function returns the matched Template ID or -1 if none.
+ */
+int AD013_MatchCacheLookup(uint32_t hash, int * score = NULL);
+
+/* !\brief Remembers a successful match of a Char (by its AD013_CharHash())
+ *
+ * AD013_SearchTemplate() records its matches already, use this function
+ * for searches done through other transports. The oldest entry is
+ * replaced when the cache is full.
+ */
+void AD013_MatchCacheAdd(uint32_t hash, int templateId, int score);
+
+/* !\brief Returns true if the Match Cache holds unexpired matches */
+bool AD013_MatchCacheLive(void);
+
+/* !\brief Forgets the cached matches of the slots startId-endId
+ *
+ * AD013_TemplateCacheBump() calls this function already.
+ */
+void AD013_MatchCacheDrop(int startId, int endId);
+
+/* !\brief Forgets all the cached matches
+ *
+ * Cached matches of a slot are dropped automatically when the library
+ * stores to or deletes from the slot.
+ */
+void AD013_MatchCacheReset(void);
+
+
+/* !\brief Estimates the quality of a captured image
+ *
+ * Use this function on an image retrieved with AD013_UpImage() (8 bits
+ * per pixel, width x height) to decide whether the capture is worth a
+ * PS_GenChar round trip or the finger should be captured again.
+ *
+ * The image is split in blocks of AD013_QUALITY_BLOCK_SIZE pixels and
+ * blocks with enough gradient energy are counted as ridge area. The
+ * computed metrics are returned in stats (if not NULL).
+ *
+ * The function returns the PS_GenChar outcome it predicts, i.e.
+ * AD013_CODE_OK for a usable image or one of AD013_CODE_FEATURE_FAIL_LIGTH_DRY,
+ * AD013_CODE_FEATURE_FAIL_DARK_WET, AD013_CODE_FEATURE_FAIL_AMORPHOUS. In
+ * case of errors, the function returns -1.
+ */
+int AD013_ImageQuality(const byte       * img,
+                       int                width,
+                       int                height,
+                       AD013_ImageStats * stats = NULL);
+
+
+/* !\brief Sets the idle time after which the module is put to sleep
+ *
+ * The idle time is counted from the last command sent to the module.
+ * Use 0 to never put the module to sleep (the default is
+ * AD013_POWER_IDLE_TIMEOUT).
+ */
+void AD013_PowerSetIdleTimeout(unsigned long idleTimeout);
+
+/* !\brief Runs the power manager (call it from loop())
+ *
+ * Puts the module to sleep (PS_Sleep) once it has been idle for the
+ * configured time, and wakes it up when a touch was signalled via
+ * AD013_PowerTouch().
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_PowerPoll(Stream & SerialPort);
+
+/* !\brief Signals a touch on the sensor
+ *
+ * Use this function as (or from) the interrupt handler of the module's
+ * touch line, e.g.:
+ *
+ *   attachInterrupt(digitalPinToInterrupt(pin), AD013_PowerTouch, RISING);
+ *
+ * The module is woken up by the next AD013_PowerPoll().
+ */
+void AD013_PowerTouch(void);
+
+/* !\brief Puts the module to sleep (low power mode)
+ *
+ * The module is woken up by AD013_PowerWake(), by the next touch (see
+ * AD013_PowerTouch()) or, transparently, by the next command.
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_PowerSleep(Stream & SerialPort);
+
+/* !\brief Wakes the module up (nothing is sent if it is awake)
+ *
+ * The password handshake is repeated until the module answers or
+ * AD013_POWER_WAKE_TIMEOUT expires. The time it took is recorded as
+ * the wake-up latency.
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_PowerWake(Stream & SerialPort);
+
+/* !\brief Returns true if the module is in low power mode */
+bool AD013_PowerIsAsleep(void);
+
+/* !\brief Returns the expected wake-up latency (ms)
+ *
+ * Use this function to budget the time of an identification: it returns
+ * 0 if the module is awake, the worst measured latency otherwise (or
+ * AD013_POWER_WAKE_TIMEOUT if none was measured yet).
+ */
+unsigned long AD013_PowerWakeLatency(void);
+
+/* !\brief Returns the power manager's counters (time asleep, wakes) */
+void AD013_PowerGetStats(AD013_PowerStats * stats);
+
+
+/* !\brief Builds the params of a LED command (PS_ControlBLN)
+ *
+ * Use this function to prepare LED commands for transports other than
+ * AD013_SetLed() (e.g., AD013_SendCmd()). The mode is one of the
+ * AD013_LED_* modes, color and endColor are combinations of the
+ * AD013_LED_* colors (use -1 for endColor to keep the same color). The
+ * breathing and flashing modes are repeated cycles times (0: forever).
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_LedParams(AD013_Params * params,
+                    int            mode,
+                    int            color,
+                    int            endColor = -1,
+                    int            cycles   = 0);
+
+/* !\brief Sets the module's LED (aura)
+ *
+ * Use the module's built-in modes (AD013_LED_BREATHE, AD013_LED_FLASH,
+ * ...) for animations: they run on the module, no further commands are
+ * needed. See AD013_LedParams() for the parameters.
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_SetLed(Stream & SerialPort,
+                 int      mode,
+                 int      color    = AD013_LED_BLUE,
+                 int      endColor = -1,
+                 int      cycles   = 0);
+
+
+/* !\brief Records the outcome of a search in the Score Statistics
+ *
+ * AD013_SearchTemplate() records its searches already, use this function
+ * for searches done through other transports. Use -1 for templateId when
+ * nothing was matched.
+ */
+void AD013_ScoreStatsAdd(int templateId, int score, bool accepted);
+
+/* !\brief Copies the Score Statistics collected so far
+ *
+ * The histograms count the scores of the accepted and of the rejected
+ * (below the threshold) matches, the per-template counters show which
+ * fingers struggle. Counters stop at 65535.
+ */
+void AD013_ScoreStatsGet(AD013_ScoreStats * stats);
+
+/* !\brief Writes the Score Statistics out as CSV
+ *
+ * One "bucket,<first score>,<accepted>,<rejected>" line per bucket, a
+ * "notfound,<searches>" line, then one
+ * "template,<id>,<accepted>,<rejected>,<min>,<max>,<mean>" line per
+ * template that was matched at least once.
+ *
+ * The function returns the number of written lines.
+ */
+int AD013_ScoreStatsExport(Print & out);
+
+/* !\brief Clears the Score Statistics */
+void AD013_ScoreStatsReset(void);
 
 #endif // AD013_FINGERPRINT_SENSOR_HEADER
@@ -0,0 +1,347 @@
+#ifndef AD013_FINGERPRINT_ASYNC_HEADER
+#define AD013_FINGERPRINT_ASYNC_HEADER
+
+#include "AD013_Reactor.h"
+
+// Awaitable Sensor Commands (C++20 coroutines, host builds only)
+//
+// Each function is a coroutine that sends its commands through an
+// AD013_Device attached to an AD013_Reactor and suspends until the
+// replies are dispatched by AD013_ReactorPoll(), so a single thread
+// can drive many sensors:
+//
+//   AD013_Task<int> identify(AD013_Device * dev) {
+//     if (co_await AD013_AsyncGetImage(dev) != AD013_CODE_OK) co_return -1;
+//     ...
+//   }
+//
+//   AD013_Task<int> task = identify(&dev);
+//   task.start();
+//   while (!task.done()) AD013_ReactorPoll(&reactor, -1);
+//
+// Unless noted, the functions return the sensor's Confirmation Code,
+// AD013_REACTOR_TIMEOUT or AD013_REACTOR_IO_ERROR.
+
+#if defined(AD013_HOST_BUILD) && __cplusplus >= 202002L
+
+#include <coroutine>
+#include <exception>
+
+// Pause between PS_GetImage polls while waiting for a finger (ms)
+#ifndef AD013_ASYNC_POLL_DELAY
+#define AD013_ASYNC_POLL_DELAY     120
+#endif
+
+// Lazily started coroutine returning a T
+template <typename T>
+class AD013_Task {
+
+  public:
+    struct promise_type;
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+    struct final_awaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(handle_type h) noexcept {
+        // Resumes the awaiting coroutine (if any)
+        if (h.promise().continuation) return h.promise().continuation;
+        return std::noop_coroutine();
+      }
+      void await_resume() noexcept { }
+    };
+
+    struct promise_type {
+      T value { };
+      std::coroutine_handle<> continuation;
+
+      AD013_Task get_return_object() { return AD013_Task(handle_type::from_promise(*this)); }
+      std::suspend_always initial_suspend() noexcept { return { }; }
+      final_awaiter final_suspend() noexcept { return { }; }
+      void return_value(T val) { value = val; }
+      void unhandled_exception() { std::terminate(); }
+    };
+
+    AD013_Task(AD013_Task && task) noexcept : _h(task._h) { task._h = nullptr; }
+    AD013_Task(const AD013_Task &) = delete;
+    AD013_Task & operator=(const AD013_Task &) = delete;
+    ~AD013_Task() { if (_h) _h.destroy(); }
+
+    // Starts the task from regular code, it then runs from the reactor
+    void start() { if (_h && !_h.done()) _h.resume(); }
+    bool done() const { return !_h || _h.done(); }
+    T result() const { return _h.promise().value; }
+
+    // Awaited from another coroutine
+    bool await_ready() const { return done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) {
+      _h.promise().continuation = h;
+      return _h;
+    }
+    T await_resume() const { return _h.promise().value; }
+
+  private:
+    explicit AD013_Task(handle_type h) : _h(h) { }
+    handle_type _h;
+};
+
+// Awaits one command (and its data packets), queued in lane
+class AD013_CommandAwaiter {
+
+  public:
+    AD013_CommandAwaiter(AD013_Device   * dev,
+                         int              code,
+                         AD013_Params   * params,
+                         AD013_DataSink   sink     = NULL,
+                         void           * sink_ctx = NULL,
+                         const byte     * send     = NULL,
+                         long             send_len = 0,
+                         unsigned long    timeout  = AD013_REACTOR_DEF_TIMEOUT,
+                         int              lane     = AD013_LANE_ACCESS)
+      : len(0), ret(0), _dev(dev), _code(code), _params(params), _sink(sink),
+        _sink_ctx(sink_ctx), _send(send), _send_len(send_len), _timeout(timeout), _lane(lane) { }
+
+    bool await_ready() const { return false; }
+
+    bool await_suspend(std::coroutine_handle<> h) {
+      int sent = -1;
+      _h = h;
+      if (_send) {
+        sent = AD013_DeviceSubmitDownload(_dev, _lane, _code, _params, _send, _send_len,
+                                          AD013_CommandAwaiter::done, this, _timeout);
+      } else {
+        sent = AD013_DeviceSubmit(_dev, _lane, _code, _params, AD013_CommandAwaiter::done,
+                                  this, _sink, _sink_ctx, _timeout);
+      }
+      // Not sent, resumes right away
+      if (sent < 0) ret = AD013_REACTOR_IO_ERROR;
+      return sent > 0;
+    }
+
+    int await_resume() const { return ret; }
+
+    // ACK Data (or bytes passed to the sink)
+    byte data[AD013_MAX_PACKET_SIZE];
+    long len;
+    int  ret;
+
+  private:
+    static void done(AD013_Device *, int code, const byte * data, long data_len, void * ctx) {
+      AD013_CommandAwaiter * self = (AD013_CommandAwaiter *) ctx;
+      self->ret = code;
+      self->len = data_len;
+      if (data && data_len > 0) memcpy(self->data, data, data_len);
+      self->_h.resume();
+    }
+
+    AD013_Device  * _dev;
+    int             _code;
+    AD013_Params  * _params;
+    AD013_DataSink  _sink;
+    void          * _sink_ctx;
+    const byte    * _send;
+    long            _send_len;
+    unsigned long   _timeout;
+    int             _lane;
+    std::coroutine_handle<> _h;
+};
+
+// Awaits a pause of ms on the device (see AD013_DeviceWait)
+class AD013_WaitAwaiter {
+
+  public:
+    AD013_WaitAwaiter(AD013_Device * dev, unsigned long ms) : ret(0), _dev(dev), _ms(ms) { }
+
+    bool await_ready() const { return false; }
+
+    bool await_suspend(std::coroutine_handle<> h) {
+      _h = h;
+      // Not armed, resumes right away
+      if (AD013_DeviceWait(_dev, _ms, AD013_WaitAwaiter::done, this) < 0) {
+        ret = AD013_REACTOR_IO_ERROR;
+        return false;
+      }
+      return true;
+    }
+
+    int await_resume() const { return ret; }
+
+    int ret;
+
+  private:
+    static void done(AD013_Device *, int code, const byte *, long, void * ctx) {
+      AD013_WaitAwaiter * self = (AD013_WaitAwaiter *) ctx;
+      self->ret = code;
+      self->_h.resume();
+    }
+
+    AD013_Device  * _dev;
+    unsigned long   _ms;
+    std::coroutine_handle<> _h;
+};
+
+// Sink that collects data packets into a buffer
+typedef struct async_buff_st {
+  byte * buff;
+  long   size;
+  long   len;
+} AD013_AsyncBuff;
+
+inline int AD013_AsyncBuffSink(const byte * data, int data_len, void * ctx) {
+  AD013_AsyncBuff * out = (AD013_AsyncBuff *) ctx;
+  if (out->len + data_len > out->size) return -1;
+  memcpy(out->buff + out->len, data, data_len);
+  out->len += data_len;
+  return 1;
+}
+
+// Appends a big-endian value to the command's parameters
+inline void AD013_AsyncParam(AD013_Params * params, int size, uint32_t val) {
+  while (size-- > 0) params->buff[params->size++] = (char)(val >> (8 * size));
+}
+
+/* !\brief Verifies the sensor's password (PS_VerifyPwd) */
+inline AD013_Task<int> AD013_AsyncVerifyPassword(AD013_Device * dev, uint32_t passwd = 0) {
+  AD013_Params params = { };
+  AD013_AsyncParam(&params, 4, passwd);
+  co_return co_await AD013_CommandAwaiter(dev, 0x13, &params);
+}
+
+/* !\brief Captures a fingerprint image (PS_GetImage) */
+inline AD013_Task<int> AD013_AsyncGetImage(AD013_Device * dev) {
+  co_return co_await AD013_CommandAwaiter(dev, 0x01, NULL);
+}
+
+/* !\brief Generates a Char from the captured image (PS_GenChar) */
+inline AD013_Task<int> AD013_AsyncGenChar(AD013_Device * dev, int bufferId = 1) {
+  AD013_Params params = { };
+  AD013_AsyncParam(&params, 1, bufferId);
+  co_return co_await AD013_CommandAwaiter(dev, 0x02, &params);
+}
+
+/* !\brief Searches the DB for the Char in bufferId (PS_Search)
+ *
+ * The matched Template ID and its score are returned in id and score
+ * (if not NULL).
+ */
+inline AD013_Task<int> AD013_AsyncSearch(AD013_Device * dev,
+                                         int            bufferId,
+                                         int            startId,
+                                         int            count,
+                                         int          * id    = NULL,
+                                         int          * score = NULL) {
+  AD013_Params params = { };
+  AD013_AsyncParam(&params, 1, bufferId);
+  AD013_AsyncParam(&params, 2, startId);
+  AD013_AsyncParam(&params, 2, count);
+
+  AD013_CommandAwaiter cmd(dev, 0x04, &params);
+  int code = co_await cmd;
+
+  if (code == AD013_CODE_OK && cmd.len >= 4) {
+    if (id) *id = cmd.data[0] << 8 | cmd.data[1];
+    if (score) *score = cmd.data[2] << 8 | cmd.data[3];
+  }
+  co_return code;
+}
+
+/* !\brief Stores the Char in bufferId as templateId (PS_StoreChar) */
+inline AD013_Task<int> AD013_AsyncStore(AD013_Device * dev, int bufferId, int templateId) {
+  AD013_Params params = { };
+  AD013_AsyncParam(&params, 1, bufferId);
+  AD013_AsyncParam(&params, 2, templateId);
+  co_return co_await AD013_CommandAwaiter(dev, 0x06, &params);
+}
+
+/* !\brief Pauses the calling coroutine for ms (other devices keep going) */
+inline AD013_Task<int> AD013_AsyncDelay(AD013_Device * dev, unsigned long ms) {
+  co_return co_await AD013_WaitAwaiter(dev, ms);
+}
+
+/* !\brief Enrolls a finger as templateId
+ *
+ * Captures samples images (waiting up to timeOut ms for each, polling
+ * every AD013_ASYNC_POLL_DELAY ms), generates their Chars, merges them
+ * (PS_RegModel) and stores the Template.
+ *
+ * Unlike AD013_Enroll(), the slot is given by the caller (no free slot
+ * lookup), the finger need not be lifted between samples, and there is
+ * no image quality gate, no retry of bad samples and no duplicate
+ * search: the first failing command ends the enrollment with its code.
+ */
+inline AD013_Task<int> AD013_AsyncEnroll(AD013_Device * dev,
+                                         int            templateId,
+                                         int            samples = AD013_ENROLL_SAMPLES,
+                                         unsigned long  timeOut = AD013_ENROLL_TIMEOUT) {
+  unsigned long start = 0;
+  int code = -1;
+
+  for (int i = 1; i <= samples; i++) {
+    // Waits for the finger
+    start = millis();
+    while ((code = co_await AD013_AsyncGetImage(dev)) == AD013_CODE_NO_FINGER &&
+           millis() - start < timeOut) {
+      if ((code = co_await AD013_AsyncDelay(dev, AD013_ASYNC_POLL_DELAY)) != AD013_CODE_OK) co_return code;
+    }
+    if (code != AD013_CODE_OK) co_return code;
+
+    if ((code = co_await AD013_AsyncGenChar(dev, i)) != AD013_CODE_OK) co_return code;
+  }
+
+  if ((code = co_await AD013_CommandAwaiter(dev, 0x05, NULL)) != AD013_CODE_OK) co_return code;
+
+  co_return co_await AD013_AsyncStore(dev, 1, templateId);
+}
+
+/* !\brief Uploads the Char in bufferId (PS_UpChar)
+ *
+ * The size of the Char is returned in len (if not NULL). Transfers go
+ * in the bulk lane unless another lane is given.
+ */
+inline AD013_Task<int> AD013_AsyncUpChar(AD013_Device * dev,
+                                         int            bufferId,
+                                         byte         * buff,
+                                         long           size,
+                                         long         * len  = NULL,
+                                         int            lane = AD013_LANE_BULK) {
+  AD013_Params params = { };
+  AD013_AsyncBuff out = { buff, size, 0 };
+  AD013_AsyncParam(&params, 1, bufferId);
+
+  int code = co_await AD013_CommandAwaiter(dev, 0x08, &params, AD013_AsyncBuffSink, &out,
+                                           NULL, 0, AD013_REACTOR_DEF_TIMEOUT, lane);
+  if (len) *len = out.len;
+  co_return code;
+}
+
+/* !\brief Uploads the captured image (PS_UpImage)
+ *
+ * The size of the image is returned in len (if not NULL).
+ */
+inline AD013_Task<int> AD013_AsyncUpImage(AD013_Device * dev,
+                                          byte         * buff,
+                                          long           size,
+                                          long         * len  = NULL,
+                                          int            lane = AD013_LANE_BULK) {
+  AD013_AsyncBuff out = { buff, size, 0 };
+
+  int code = co_await AD013_CommandAwaiter(dev, 0x0A, NULL, AD013_AsyncBuffSink, &out,
+                                           NULL, 0, AD013_REACTOR_DEF_TIMEOUT, lane);
+  if (len) *len = out.len;
+  co_return code;
+}
+
+/* !\brief Downloads a Char into bufferId (PS_DownChar) */
+inline AD013_Task<int> AD013_AsyncDownChar(AD013_Device * dev,
+                                           int            bufferId,
+                                           const byte   * data,
+                                           long           data_len,
+                                           int            lane = AD013_LANE_BULK) {
+  AD013_Params params = { };
+  AD013_AsyncParam(&params, 1, bufferId);
+  co_return co_await AD013_CommandAwaiter(dev, 0x09, &params, NULL, NULL, data, data_len,
+                                          AD013_REACTOR_DEF_TIMEOUT, lane);
+}
+
+#endif // AD013_HOST_BUILD && C++20
+
+#endif // AD013_FINGERPRINT_ASYNC_HEADER
@@ -0,0 +1,422 @@
+
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Fingerprint / RFID / BLE Project
+// ================================================
+
+// Local Include
+#include "AD013_Gallery.h"
+#include "AD013_Log.h"
+
+#ifdef AD013_HOST_BUILD
+
+// System Includes
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Global Definitions
+#define AD013_GALLERY_ALIGN        64
+
+#define AD013_GALLERY_ROUND(a, b) \
+  ((((a) + (b) - 1) / (b)) * (b))
+
+#define AD013_GALLERY_RECORD(g, n) \
+  ((AD013_GalleryRecord *)((g)->records + (size_t)(n) * (g)->hdr->record_size))
+
+                        // =============================
+                        // Internal Functions Prototypes
+                        // =============================
+
+uint32_t AD013_GalleryHeaderCrc(const AD013_GalleryHeader * hdr);
+
+                        // =========================
+                        // Gallery Utility Functions
+                        // =========================
+
+uint32_t AD013_GalleryHeaderCrc(const AD013_GalleryHeader * hdr) {
+
+  // Covers the layout fields (i.e., everything before the crc)
+  return AD013_Crc32(0, (const byte *) hdr, offsetof(AD013_GalleryHeader, crc));
+}
+
+                        // ========================
+                        // Gallery Public Functions
+                        // ========================
+
+int AD013_GalleryCreate(const char * path,
+                        uint32_t     capacity,
+                        uint32_t     template_size) {
+
+  AD013_GalleryHeader hdr;
+  size_t map_len = 0;
+  byte * map = NULL;
+  int fd = -1;
+
+  if (!path || capacity < 1 || template_size < 1) return -1;
+
+  // Builds the Layout
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, AD013_GALLERY_MAGIC, sizeof(hdr.magic));
+  hdr.version = AD013_GALLERY_VERSION;
+  hdr.capacity = capacity;
+  hdr.template_size = template_size;
+  hdr.record_size = AD013_GALLERY_ROUND(sizeof(AD013_GalleryRecord) + template_size, 8);
+  hdr.index_offset = AD013_GALLERY_ROUND(sizeof(hdr), AD013_GALLERY_ALIGN);
+  hdr.records_offset = AD013_GALLERY_ROUND(hdr.index_offset +
+    capacity * sizeof(AD013_GalleryIndex), AD013_GALLERY_ALIGN);
+  hdr.crc = AD013_GalleryHeaderCrc(&hdr);
+  hdr.count = 0;
+
+  map_len = hdr.records_offset + (size_t) capacity * hdr.record_size;
+
+  if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+    AD013_LOG_ERROR("Cannot Create Gallery (errno %d)", errno);
+    return -1;
+  }
+
+  if (ftruncate(fd, map_len) < 0 ||
+      (map = (byte *) mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+
+  // Header and Empty Index (records are zero-filled by ftruncate)
+  memcpy(map, &hdr, sizeof(hdr));
+  memset(map + hdr.index_offset, 0xFF, capacity * sizeof(AD013_GalleryIndex));
+
+  msync(map, map_len, MS_SYNC);
+  munmap(map, map_len);
+  close(fd);
+
+  return 1;
+}
+
+int AD013_GalleryOpen(AD013_Gallery * gallery,
+                      const char    * path,
+                      bool            writable) {
+
+  AD013_GalleryHeader * hdr = NULL;
+  struct stat st;
+
+  if (!gallery || !path) return -1;
+
+  memset(gallery, 0, sizeof(AD013_Gallery));
+  gallery->fd = -1;
+
+  if ((gallery->fd = open(path, writable ? O_RDWR : O_RDONLY)) < 0 ||
+      fstat(gallery->fd, &st) < 0 || st.st_size < (off_t) sizeof(AD013_GalleryHeader)) {
+    AD013_LOG_ERROR("Cannot Open Gallery");
+    goto err;
+  }
+
+  gallery->map_len = st.st_size;
+  gallery->map = (byte *) mmap(NULL, gallery->map_len,
+    writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, gallery->fd, 0);
+  if (gallery->map == MAP_FAILED) {
+    gallery->map = NULL;
+    goto err;
+  }
+
+  // Validates the Header (only), no parsing of the records
+  hdr = (AD013_GalleryHeader *) gallery->map;
+  if (memcmp(hdr->magic, AD013_GALLERY_MAGIC, sizeof(hdr->magic)) != 0 ||
+      hdr->version != AD013_GALLERY_VERSION ||
+      hdr->crc != AD013_GalleryHeaderCrc(hdr) ||
+      hdr->count > hdr->capacity ||
+      hdr->record_size < sizeof(AD013_GalleryRecord) + hdr->template_size ||
+      hdr->index_offset < sizeof(AD013_GalleryHeader) ||
+      hdr->records_offset < hdr->index_offset +
+        (uint64_t) hdr->capacity * sizeof(AD013_GalleryIndex) ||
+      gallery->map_len < hdr->records_offset + (uint64_t) hdr->capacity * hdr->record_size) {
+    AD013_LOG_ERROR("Bad Gallery Header");
+    goto err;
+  }
+
+  gallery->hdr = hdr;
+  gallery->writable = writable;
+  gallery->index = (AD013_GalleryIndex *)(gallery->map + hdr->index_offset);
+  gallery->records = gallery->map + hdr->records_offset;
+
+  // The matcher scans the records in order
+  madvise(gallery->records, (size_t) hdr->count * hdr->record_size, MADV_WILLNEED);
+
+  return 1;
+
+err:
+
+  AD013_GalleryClose(gallery);
+  return -1;
+}
+
+void AD013_GalleryClose(AD013_Gallery * gallery) {
+
+  if (!gallery) return;
+
+  if (gallery->map) munmap(gallery->map, gallery->map_len);
+  if (gallery->fd >= 0) close(gallery->fd);
+
+  memset(gallery, 0, sizeof(AD013_Gallery));
+  gallery->fd = -1;
+}
+
+int AD013_GalleryVerify(AD013_Gallery * gallery) {
+
+  AD013_GalleryRecord * rec = NULL;
+
+  if (!gallery || !gallery->hdr) return -1;
+
+  for (uint32_t n = 0; n < gallery->hdr->count; n++) {
+    rec = AD013_GALLERY_RECORD(gallery, n);
+    if (rec->id >= gallery->hdr->capacity ||
+        rec->len > gallery->hdr->template_size ||
+        gallery->index[rec->id].record != n ||
+        gallery->index[rec->id].crc != AD013_Crc32(0, (byte *)(rec + 1), rec->len)) {
+      AD013_LOG_ERROR("Gallery Record %u is corrupted", n);
+      return -1;
+    }
+  }
+
+  return gallery->hdr->count;
+}
+
+const byte * AD013_GalleryGet(AD013_Gallery * gallery,
+                              int             id,
+                              long          * len) {
+
+  if (!gallery || !gallery->hdr || id < 0 || (uint32_t) id >= gallery->hdr->capacity ||
+      gallery->index[id].record == AD013_GALLERY_NO_RECORD)
+    return NULL;
+
+  return AD013_GalleryAt(gallery, gallery->index[id].record, NULL, len);
+}
+
+const byte * AD013_GalleryAt(AD013_Gallery * gallery,
+                             uint32_t        n,
+                             int           * id,
+                             long          * len) {
+
+  AD013_GalleryRecord * rec = NULL;
+
+  if (!gallery || !gallery->hdr || n >= gallery->hdr->count) return NULL;
+
+  rec = AD013_GALLERY_RECORD(gallery, n);
+  if (id) *id = rec->id;
+  if (len) *len = rec->len;
+
+  return (const byte *)(rec + 1);
+}
+
+int AD013_GalleryPut(AD013_Gallery * gallery,
+                     int             id,
+                     const byte    * tpl,
+                     long            len) {
+
+  AD013_GalleryHeader * hdr = NULL;
+  AD013_GalleryRecord * rec = NULL;
+  uint32_t n = 0;
+
+  if (!gallery || !(hdr = gallery->hdr) || !gallery->writable || !tpl || len < 0 ||
+      id < 0 || (uint32_t) id >= hdr->capacity || (uint32_t) len > hdr->template_size)
+    return -1;
+
+  // Replaces the existing record or appends a new one
+  if ((n = gallery->index[id].record) == AD013_GALLERY_NO_RECORD) n = hdr->count;
+
+  rec = AD013_GALLERY_RECORD(gallery, n);
+  rec->id = id;
+  rec->len = len;
+  memcpy(rec + 1, tpl, len);
+
+  // Commits the record
+  gallery->index[id].crc = AD013_Crc32(0, tpl, len);
+  gallery->index[id].record = n;
+  if (n == hdr->count) hdr->count++;
+
+  return 1;
+}
+
+int AD013_GalleryDelete(AD013_Gallery * gallery, int id) {
+
+  AD013_GalleryHeader * hdr = NULL;
+  AD013_GalleryRecord * last = NULL;
+  uint32_t n = 0;
+
+  if (!gallery || !(hdr = gallery->hdr) || !gallery->writable ||
+      id < 0 || (uint32_t) id >= hdr->capacity)
+    return -1;
+
+  if ((n = gallery->index[id].record) == AD013_GALLERY_NO_RECORD) return 0;
+
+  // Keeps the records dense by moving the last one into the hole
+  if (n != hdr->count - 1) {
+    last = AD013_GALLERY_RECORD(gallery, hdr->count - 1);
+    memcpy(AD013_GALLERY_RECORD(gallery, n), last, sizeof(AD013_GalleryRecord) + last->len);
+    gallery->index[last->id].record = n;
+  }
+
+  gallery->index[id].record = AD013_GALLERY_NO_RECORD;
+  gallery->index[id].crc = AD013_GALLERY_NO_RECORD;
+  hdr->count--;
+
+  return 1;
+}
+
+int AD013_GalleryImport(AD013_Gallery * gallery,
+                        Stream        & SensorCom,
+                        int             startId,
+                        int             endId) {
+
+  byte * tpl = NULL;
+  long len = 0;
+  int loaded = 0;
+  int ret = 0;
+
+  if (!gallery || !gallery->hdr || startId < 0 || endId < startId) return -1;
+
+  if ((tpl = (byte *) malloc(gallery->hdr->template_size)) == NULL) return -1;
+
+  for (int id = startId; id <= endId; id++) {
+
+    // Skips slots already in the gallery and unchanged since then
+    if (AD013_GalleryGet(gallery, id) &&
+        AD013_TemplateCacheGet(id) == gallery->index[id].crc) continue;
+
+    // Empty slots are skipped, any other failure stops the import
+    if ((loaded = AD013_LoadTemplate(SensorCom, id, 1)) == 0) continue;
+
+    if (loaded < 0 ||
+        (len = AD013_UpChar(SensorCom, 1, tpl, gallery->hdr->template_size)) < 0 ||
+        AD013_GalleryPut(gallery, id, tpl, len) < 0) {
+      AD013_LOG_ERROR("Cannot Import Template %d", id);
+      ret = -1;
+      break;
+    }
+
+    AD013_TemplateCacheSet(id, gallery->index[id].crc);
+    ret++;
+  }
+
+  free(tpl);
+
+  return ret;
+}
+
+int AD013_GalleryExport(AD013_Gallery * gallery,
+                        Stream        & SensorCom,
+                        int             startId,
+                        int             endId) {
+
+  const byte * tpl = NULL;
+  long len = 0;
+  int ret = 0;
+
+  if (!gallery || !gallery->hdr || startId < 0 || endId < startId) return -1;
+
+  for (int id = startId; id <= endId; id++) {
+
+    // IDs missing from the gallery are skipped
+    if ((tpl = AD013_GalleryGet(gallery, id, &len)) == NULL) continue;
+
+    if (AD013_DownChar(SensorCom, 1, tpl, len) < 0 ||
+        AD013_StoreTemplate(SensorCom, 1, id) < 0) {
+      AD013_LOG_ERROR("Cannot Export Template %d", id);
+      return -1;
+    }
+
+    AD013_TemplateCacheSet(id, gallery->index[id].crc);
+    ret++;
+  }
+
+  return ret;
+}
+
+int AD013_GallerySync(AD013_Gallery          * gallery,
+                      Stream                 & SensorCom,
+                      int                      startId,
+                      int                      endId,
+                      AD013_GallerySyncStats * stats) {
+
+  AD013_GallerySyncStats myStats = { 0 };
+  byte bitmap[AD013_INDEX_PAGE_SIZE * ((AD013_MAX_TEMPLATES + 255) / 256)];
+  const byte * tpl = NULL;
+  byte * buff = NULL;
+  long len = 0;
+  int run = -1;
+  int ret = -1;
+  uint32_t known = 0;
+
+  if (!gallery || !gallery->hdr || startId < 0 || endId < startId ||
+      endId >= AD013_MAX_TEMPLATES || (uint32_t) endId >= gallery->hdr->capacity)
+    return -1;
+
+  if (!stats) stats = &myStats;
+  memset(stats, 0, sizeof(AD013_GallerySyncStats));
+
+  // Gets the sensor's occupancy
+  if (AD013_ReadIndexTable(SensorCom, bitmap, sizeof(bitmap)) < 0) return -1;
+
+  if ((buff = (byte *) malloc(gallery->hdr->template_size)) == NULL) return -1;
+
+  // Walks one past the end to flush the last delete run
+  for (int id = startId; id <= endId + 1; id++) {
+
+    bool used = (id <= endId && AD013_IndexTableIsUsed(bitmap, id));
+    tpl = (id <= endId ? AD013_GalleryGet(gallery, id, &len) : NULL);
+
+    // Slots to be removed are collected in contiguous runs
+    if (used && !tpl) {
+      if (run < 0) run = id;
+      continue;
+    }
+
+    if (run >= 0) {
+      if (AD013_ClearTemplates(SensorCom, run, id - 1) < 0) goto end;
+      stats->deleted += id - run;
+      run = -1;
+    }
+
+    if (id > endId) break;
+
+    if (!tpl) continue;
+
+    // Occupied slots with unknown contents are hashed once
+    if (used && (known = AD013_TemplateCacheGet(id)) == 0) {
+      if (AD013_FetchTemplate(SensorCom, id, buff, gallery->hdr->template_size) < 0)
+        goto end;
+      known = AD013_TemplateCacheGet(id);
+      stats->fetched++;
+    }
+
+    // Nothing to do if the slot already holds the Template
+    if (used && known == gallery->index[id].crc) continue;
+
+    if (AD013_DownChar(SensorCom, 1, tpl, len) < 0 ||
+        AD013_StoreTemplate(SensorCom, 1, id) < 0)
+      goto end;
+
+    AD013_TemplateCacheSet(id, gallery->index[id].crc);
+    stats->pushed++;
+  }
+
+  ret = stats->pushed + stats->deleted;
+
+end:
+
+  if (ret < 0) {
+    AD013_LOG_ERROR("Gallery Sync Failed (pushed %d, deleted %d)",
+      stats->pushed, stats->deleted);
+  }
+
+  free(buff);
+
+  return ret;
+}
+
+#endif // AD013_HOST_BUILD
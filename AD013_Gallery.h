@@ -0,0 +1,196 @@
+#ifndef AD013_FINGERPRINT_GALLERY_HEADER
+#define AD013_FINGERPRINT_GALLERY_HEADER
+
+#include "AD013.h"
+
+#ifdef AD013_HOST_BUILD
+
+// Gallery File Format
+//
+//   [ Header ][ ID Index (capacity entries) ][ Records (capacity) ]
+//
+// Records have a fixed stride and are kept dense (the first 'count'
+// records are in use), so matchers can scan them directly from the
+// mapped file. The ID Index maps Template IDs to records. All values
+// are stored in the host's native byte order.
+
+#define AD013_GALLERY_MAGIC       "AD013GAL"
+#define AD013_GALLERY_VERSION     1
+#define AD013_GALLERY_NO_RECORD   0xFFFFFFFF
+
+// Gallery File Header
+typedef struct gallery_header_st {
+  char     magic[8];       /* AD013_GALLERY_MAGIC */
+  uint32_t version;        /* AD013_GALLERY_VERSION */
+  uint32_t capacity;       /* Max Templates (IDs 0 .. capacity - 1) */
+  uint32_t template_size;  /* Max Template Size (bytes) */
+  uint32_t record_size;    /* Record Stride (bytes) */
+  uint32_t index_offset;   /* Offset of the ID Index */
+  uint32_t records_offset; /* Offset of the first Record */
+  uint32_t crc;            /* CRC32 of the fields above */
+  uint32_t count;          /* Records in use */
+} AD013_GalleryHeader;
+
+// ID Index Entry
+typedef struct gallery_index_st {
+  uint32_t record;         /* Record Number or AD013_GALLERY_NO_RECORD */
+  uint32_t crc;            /* CRC32 of the Template */
+} AD013_GalleryIndex;
+
+// Record Header (followed by template_size bytes of data)
+typedef struct gallery_record_st {
+  uint32_t id;             /* Template ID */
+  uint32_t len;            /* Template Size (bytes) */
+} AD013_GalleryRecord;
+
+// Opened Gallery
+typedef struct gallery_st {
+  int                   fd;
+  size_t                map_len;
+  byte                * map;
+  AD013_GalleryHeader * hdr;
+  AD013_GalleryIndex  * index;
+  byte                * records;
+  bool                  writable;  /* Mapped for writing */
+} AD013_Gallery;
+
+
+/* !\brief Creates a new (empty) gallery file
+ *
+ * Use this function to create a gallery that can hold up to capacity
+ * Templates (IDs 0 to capacity - 1) of template_size bytes each. An
+ * existing file at path is replaced.
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_GalleryCreate(const char * path,
+                        uint32_t     capacity,
+                        uint32_t     template_size = AD013_TEMPLATE_MAX_SIZE);
+
+/* !\brief Opens (maps) a gallery file
+ *
+ * The file is mapped into memory and only the header is validated, so
+ * opening takes constant time regardless of the number of Templates.
+ * Use AD013_GalleryVerify() to check the Templates' checksums.
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_GalleryOpen(AD013_Gallery * gallery,
+                      const char    * path,
+                      bool            writable = false);
+
+/* !\brief Closes (unmaps) a gallery file */
+void AD013_GalleryClose(AD013_Gallery * gallery);
+
+/* !\brief Checks the checksums of all the Templates in the gallery
+ *
+ * The function returns the number of Templates checked or -1 if any
+ * Template does not match its checksum.
+ */
+int AD013_GalleryVerify(AD013_Gallery * gallery);
+
+/* !\brief Returns the Template with the given ID
+ *
+ * The returned pointer points directly into the mapped file and stays
+ * valid until the Template is modified or the gallery is closed. The
+ * size of the Template is returned in len (if not NULL).
+ *
+ * The function returns NULL if the ID is not in the gallery.
+ */
+const byte * AD013_GalleryGet(AD013_Gallery * gallery,
+                              int             id,
+                              long          * len = NULL);
+
+/* !\brief Returns the n-th Template of the gallery (0 to count - 1)
+ *
+ * Use this function to scan all the Templates, the ID of the Template
+ * is returned in id (if not NULL) and its size in len (if not NULL).
+ *
+ * The function returns NULL if n is out of range.
+ */
+const byte * AD013_GalleryAt(AD013_Gallery * gallery,
+                             uint32_t        n,
+                             int           * id  = NULL,
+                             long          * len = NULL);
+
+/* !\brief Adds or replaces the Template with the given ID
+ *
+ * The gallery must be opened as writable.
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_GalleryPut(AD013_Gallery * gallery,
+                     int             id,
+                     const byte    * tpl,
+                     long            len);
+
+/* !\brief Removes the Template with the given ID
+ *
+ * The gallery must be opened as writable.
+ *
+ * The function returns 1 in case of success, 0 if the ID was not in
+ * the gallery, and -1 if any error occurs.
+ */
+int AD013_GalleryDelete(AD013_Gallery * gallery, int id);
+
+/* !\brief Imports Templates from the sensor into the gallery
+ *
+ * Use this function to fetch the Templates stored at IDs startId to
+ * endId (inclusive) via PS_LoadChar/PS_UpChar and store them in the
+ * gallery under the same IDs. Empty sensor slots are skipped, as are
+ * slots the Template Cache knows to match the gallery.
+ *
+ * The function returns the number of imported Templates or -1 if any
+ * error occurs.
+ */
+int AD013_GalleryImport(AD013_Gallery * gallery,
+                        Stream        & SerialPort,
+                        int             startId,
+                        int             endId);
+
+/* !\brief Exports Templates from the gallery into the sensor
+ *
+ * Use this function to send the gallery Templates with IDs startId to
+ * endId (inclusive) to the sensor via PS_DownChar/PS_StoreChar, under
+ * the same IDs. IDs missing from the gallery are skipped.
+ *
+ * The function returns the number of exported Templates or -1 if any
+ * error occurs.
+ */
+int AD013_GalleryExport(AD013_Gallery * gallery,
+                        Stream        & SerialPort,
+                        int             startId,
+                        int             endId);
+
+// Sync Statistics
+typedef struct gallery_sync_stats_st {
+  int pushed;              /* Templates sent (DownChar + Store) */
+  int deleted;             /* Templates removed */
+  int fetched;             /* Templates fetched to compute their hash */
+} AD013_GallerySyncStats;
+
+/* !\brief Brings the sensor's fingerprint DB in step with the gallery
+ *
+ * Use this function to make the sensor's Templates startId to endId
+ * (inclusive) match the gallery. The sensor's occupancy bitmap is
+ * compared with the gallery and only the differences are applied:
+ * Templates missing from the sensor or with different contents are
+ * sent (PS_DownChar + PS_StoreChar), and Templates not in the gallery
+ * are removed with one PS_DeletChar per contiguous range.
+ *
+ * The contents of the sensor's slots are compared through the Template
+ * Cache (see AD013_TemplateCacheGet()). Occupied slots with unknown or
+ * stale hashes are fetched once (AD013_FetchTemplate()).
+ *
+ * The function returns the number of changed slots or -1 if any error
+ * occurs. Details are returned in stats (if not NULL).
+ */
+int AD013_GallerySync(AD013_Gallery          * gallery,
+                      Stream                 & SerialPort,
+                      int                      startId,
+                      int                      endId,
+                      AD013_GallerySyncStats * stats = NULL);
+
+#endif // AD013_HOST_BUILD
+
+#endif // AD013_FINGERPRINT_GALLERY_HEADER
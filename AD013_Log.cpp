@@ -0,0 +1,209 @@
+
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Fingerprint / RFID / BLE Project
+// ================================================
+
+// Local Include
+#include "AD013_Log.h"
+
+#if AD013_LOG_LEVEL > AD013_LOG_LEVEL_NONE
+
+// Ring indexes are 8-bit
+#if AD013_LOG_RING_SIZE > 256
+#error "AD013_LOG_RING_SIZE cannot exceed 256"
+#endif
+
+                        // ================
+                        // Global Variables
+                        // ================
+
+// Pending Records (written by the library, read by AD013_LogFlush())
+static AD013_LogRecord AD013_LogRing[AD013_LOG_RING_SIZE];
+static volatile uint8_t AD013_LogHead = 0;
+static volatile uint8_t AD013_LogTail = 0;
+static uint16_t AD013_LogDropped = 0;
+
+                        // =============================
+                        // Internal Functions Prototypes
+                        // =============================
+
+void AD013_LogNumber(Print & out, unsigned long val, int base, bool upper,
+                     bool neg, int width, bool zero, bool left);
+void AD013_LogFormat(Print & out, const AD013_LogRecord * rec);
+
+                        // ======================
+                        // Log Internal Functions
+                        // ======================
+
+void AD013_LogNumber(Print       & out,
+                     unsigned long val,
+                     int           base,
+                     bool          upper,
+                     bool          neg,
+                     int           width,
+                     bool          zero,
+                     bool          left) {
+
+  char digits[12];
+  int len = 0;
+  int pad = 0;
+
+  do {
+    int d = val % base;
+    digits[len++] = d < 10 ? '0' + d : (upper ? 'A' : 'a') + d - 10;
+    val /= base;
+  } while (val && len < (int) sizeof(digits));
+
+  pad = width - len - (neg ? 1 : 0);
+
+  if (neg && zero) out.write('-');
+  if (!left) while (pad-- > 0) out.write(zero ? '0' : ' ');
+  if (neg && !zero) out.write('-');
+  while (len > 0) out.write(digits[--len]);
+  if (left) while (pad-- > 0) out.write(' ');
+}
+
+void AD013_LogFormat(Print & out, const AD013_LogRecord * rec) {
+
+  const char * p = rec->fmt;
+  int arg = 0;
+  long val = 0;
+  char c = 0;
+  int width = 0;
+  bool zero = false;
+  bool left = false;
+
+  while ((c = AD013_LOG_FMT_BYTE(p++)) != '\0') {
+
+    if (c != '%') {
+      out.write(c);
+      continue;
+    }
+
+    // Flags, Width and Length
+    zero = left = false;
+    width = 0;
+    for (;; p++) {
+      c = AD013_LOG_FMT_BYTE(p);
+      if (c == '0') zero = true;
+      else if (c == '-') left = true;
+      else break;
+    }
+    while ((c = AD013_LOG_FMT_BYTE(p)) >= '0' && c <= '9') {
+      width = width * 10 + c - '0';
+      p++;
+    }
+    while ((c = AD013_LOG_FMT_BYTE(p)) == 'l') p++;
+
+    c = AD013_LOG_FMT_BYTE(p++);
+    if (c == '\0') break;
+    if (c == '%') {
+      out.write('%');
+      continue;
+    }
+
+    val = arg < rec->argc ? rec->argv[arg] : 0;
+    arg++;
+
+    switch (c) {
+      case 'd':
+      case 'i':
+        AD013_LogNumber(out, val < 0 ? -(unsigned long) val : val, 10, false,
+                        val < 0, width, zero, left);
+        break;
+      case 'u':
+        AD013_LogNumber(out, val, 10, false, false, width, zero, left);
+        break;
+      case 'x':
+      case 'X':
+        AD013_LogNumber(out, val, 16, c == 'X', false, width, zero, left);
+        break;
+      case 'c':
+        out.write((char) val);
+        break;
+      default:
+        out.write('?');
+    }
+  }
+
+  out.write('\n');
+}
+
+                        // ====================
+                        // Log Public Functions
+                        // ====================
+
+void AD013_LogPush(uint8_t      level,
+                   const char * fmt,
+                   const long * argv,
+                   int          argc) {
+
+  uint8_t head = AD013_LogHead;
+  uint8_t next = (head + 1) % AD013_LOG_RING_SIZE;
+  AD013_LogRecord * rec = NULL;
+
+  // Full, the record is lost
+  if (next == AD013_LogTail) {
+    AD013_LogDropped++;
+    return;
+  }
+
+  if (argc > AD013_LOG_MAX_ARGS) argc = AD013_LOG_MAX_ARGS;
+
+  rec = &AD013_LogRing[head];
+  rec->fmt = fmt;
+  rec->level = level;
+  rec->argc = argc;
+  for (int i = 0; i < argc; i++) rec->argv[i] = argv[i];
+
+  AD013_LogHead = next;
+}
+
+int AD013_LogFlush(Print & out, int max) {
+
+  static const char * const prefix[] = { "", "ERROR: ", "WARN: ", "", "" };
+  const AD013_LogRecord * rec = NULL;
+  const char * pnt = NULL;
+  int count = 0;
+
+  if (AD013_LogDropped) {
+    out.print("LOG: ");
+    AD013_LogNumber(out, AD013_LogDropped, 10, false, false, 0, false, false);
+    out.print(" records dropped\n");
+    AD013_LogDropped = 0;
+  }
+
+  while (AD013_LogTail != AD013_LogHead && (max < 0 || count < max)) {
+
+    rec = &AD013_LogRing[AD013_LogTail];
+
+    for (pnt = prefix[rec->level <= AD013_LOG_LEVEL_DEBUG ? rec->level : 0]; *pnt; pnt++) {
+      out.write(*pnt);
+    }
+    AD013_LogFormat(out, rec);
+
+    AD013_LogTail = (AD013_LogTail + 1) % AD013_LOG_RING_SIZE;
+    count++;
+  }
+
+  return count;
+}
+
+int AD013_LogPending(void) {
+  return (AD013_LogHead + AD013_LOG_RING_SIZE - AD013_LogTail) % AD013_LOG_RING_SIZE;
+}
+
+#else
+
+// Logging is compiled out
+void AD013_LogPush(uint8_t, const char *, const long *, int) { }
+
+int AD013_LogFlush(Print &, int) { return 0; }
+
+int AD013_LogPending(void) { return 0; }
+
+#endif
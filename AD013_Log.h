@@ -0,0 +1,123 @@
+#ifndef AD013_FINGERPRINT_LOG_HEADER
+#define AD013_FINGERPRINT_LOG_HEADER
+
+#include "AD013.h"
+
+// Deferred Logging
+//
+// Log calls only store the (flash) format string and up to
+// AD013_LOG_MAX_ARGS integer arguments into a ring, no text is
+// formatted in the caller's path. The records are formatted and
+// written out later, from AD013_LogFlush() (e.g., from loop()).
+//
+// Messages above AD013_LOG_LEVEL are removed at compile time, so
+// release builds (AD013_LOG_LEVEL_NONE, the default unless
+// AD013_DEBUG is defined) contain no logging code at all.
+//
+// Formats support %d, %i, %u, %x, %X, %c and %% with the '0' and '-'
+// flags and a width ('l' is accepted and ignored).
+
+// Log Levels
+#define AD013_LOG_LEVEL_NONE       0
+#define AD013_LOG_LEVEL_ERROR      1
+#define AD013_LOG_LEVEL_WARN       2
+#define AD013_LOG_LEVEL_INFO       3
+#define AD013_LOG_LEVEL_DEBUG      4
+
+#ifndef AD013_LOG_LEVEL
+#ifdef AD013_DEBUG
+#define AD013_LOG_LEVEL            AD013_LOG_LEVEL_DEBUG
+#else
+#define AD013_LOG_LEVEL            AD013_LOG_LEVEL_NONE
+#endif
+#endif
+
+// Records kept until the next flush
+#ifndef AD013_LOG_RING_SIZE
+#ifdef AD013_HOST_BUILD
+#define AD013_LOG_RING_SIZE        64
+#else
+#define AD013_LOG_RING_SIZE         8
+#endif
+#endif
+
+#define AD013_LOG_MAX_ARGS          5
+
+// Format strings live in flash (AVR)
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define AD013_LOG_FMT_BYTE(p)      pgm_read_byte(p)
+#else
+#define AD013_LOG_FMT_BYTE(p)      (*(const char *)(p))
+#endif
+
+#ifndef PSTR
+#define PSTR(s)                    (s)
+#endif
+
+// Log Record
+typedef struct log_record_st {
+  const char * fmt;                       /* Format (flash) */
+  uint8_t      level;
+  uint8_t      argc;
+  long         argv[AD013_LOG_MAX_ARGS];
+} AD013_LogRecord;
+
+
+/* !\brief Stores a log record (use the AD013_LOG_* macros instead)
+ *
+ * When the ring is full, the record is dropped and counted.
+ */
+void AD013_LogPush(uint8_t      level,
+                   const char * fmt,
+                   const long * argv,
+                   int          argc);
+
+/* !\brief Formats and writes out the pending log records
+ *
+ * Writes up to max records (all if max < 0) to out, one line each. The
+ * number of dropped records (if any) is reported first.
+ *
+ * The function returns the number of written records.
+ */
+int AD013_LogFlush(Print & out, int max = -1);
+
+/* !\brief Returns the number of pending log records */
+int AD013_LogPending(void);
+
+// Captures the arguments as longs
+template <typename... Args>
+inline void AD013_LogDefer(uint8_t level, const char * fmt, Args... args) {
+  const long argv[] = { 0, ((long) args)... };
+  AD013_LogPush(level, fmt, argv + 1, sizeof...(args));
+}
+
+#if AD013_LOG_LEVEL >= AD013_LOG_LEVEL_ERROR
+#define AD013_LOG_ERROR(fmt, ...) \
+  AD013_LogDefer(AD013_LOG_LEVEL_ERROR, PSTR(fmt), ##__VA_ARGS__)
+#else
+#define AD013_LOG_ERROR(fmt, ...)  do { } while (0)
+#endif
+
+#if AD013_LOG_LEVEL >= AD013_LOG_LEVEL_WARN
+#define AD013_LOG_WARN(fmt, ...) \
+  AD013_LogDefer(AD013_LOG_LEVEL_WARN, PSTR(fmt), ##__VA_ARGS__)
+#else
+#define AD013_LOG_WARN(fmt, ...)   do { } while (0)
+#endif
+
+#if AD013_LOG_LEVEL >= AD013_LOG_LEVEL_INFO
+#define AD013_LOG_INFO(fmt, ...) \
+  AD013_LogDefer(AD013_LOG_LEVEL_INFO, PSTR(fmt), ##__VA_ARGS__)
+#else
+#define AD013_LOG_INFO(fmt, ...)   do { } while (0)
+#endif
+
+#if AD013_LOG_LEVEL >= AD013_LOG_LEVEL_DEBUG
+#define AD013_LOG_DEBUG(fmt, ...) \
+  AD013_LogDefer(AD013_LOG_LEVEL_DEBUG, PSTR(fmt), ##__VA_ARGS__)
+#else
+#define AD013_LOG_DEBUG(fmt, ...)  do { } while (0)
+#endif
+
+#endif // AD013_FINGERPRINT_LOG_HEADER
@@ -0,0 +1,734 @@
+
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Fingerprint / RFID / BLE Project
+// ================================================
+
+// Local Include
+#include "AD013_Reactor.h"
+#include "AD013_Log.h"
+
+#ifdef AD013_HOST_BUILD
+
+// System Includes
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+// Global Definitions
+#define AD013_REACTOR_READ_SIZE    512
+
+// Write side of a device (used to build and send packets)
+class AD013_FdStream : public Stream {
+
+  public:
+    AD013_FdStream(int fd) : _fd(fd), _err(false) { }
+
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+
+    virtual size_t write(uint8_t c) { return write(&c, 1); }
+    virtual size_t write(const uint8_t * buff, size_t size);
+    using Print::write;
+
+    bool failed() const { return _err; }
+
+  protected:
+    int  _fd;
+    bool _err;
+};
+
+                        // =============================
+                        // Internal Functions Prototypes
+                        // =============================
+
+// From AD013.cpp
+int AD013_BuildCmd(char * buff, int code, AD013_Params * params);
+
+long AD013_SendPacket(Stream     & SensorCom,
+                      const byte * buff,
+                      long         buff_len,
+                      int          packetSize);
+
+int AD013_DeviceStart(AD013_Device  * dev,
+                      int             code,
+                      AD013_Params  * params,
+                      AD013_ReplyFunc reply,
+                      void          * ctx,
+                      unsigned long   timeout);
+
+void AD013_DeviceComplete(AD013_Device * dev,
+                          int            code,
+                          const byte   * data,
+                          long           data_len);
+
+int AD013_DeviceFrame(AD013_Device * dev);
+
+int AD013_DeviceLedFlush(AD013_Device * dev);
+
+int AD013_DeviceLedIdle(AD013_Device * dev);
+
+int AD013_DeviceWriteCmd(AD013_Device * dev);
+
+void AD013_DeviceWaitDone(AD013_Device * dev, int code);
+
+int AD013_DeviceSchedule(AD013_Device * dev, int lane, const AD013_DeviceJob * job);
+
+int AD013_DeviceSendJob(AD013_Device * dev, const AD013_DeviceJob * job);
+
+void AD013_DeviceNext(AD013_Device * dev);
+
+int AD013_DeviceSendPacket(AD013_Device * dev);
+
+                        // ==========================
+                        // Reactor Internal Functions
+                        // ==========================
+
+size_t AD013_FdStream::write(const uint8_t * buff, size_t size) {
+
+  struct pollfd pfd = { _fd, POLLOUT, 0 };
+  size_t total = 0;
+  ssize_t ret = 0;
+
+  while (!_err && total < size) {
+    ret = ::write(_fd, buff + total, size - total);
+    if (ret > 0) {
+      total += ret;
+    } else if (ret < 0 && (errno == EAGAIN || errno == EINTR)) {
+      // The tty's output queue is full
+      if (::poll(&pfd, 1, AD013_REACTOR_DEF_TIMEOUT) <= 0) _err = true;
+    } else {
+      _err = true;
+    }
+  }
+
+  return total;
+}
+
+int AD013_DeviceStart(AD013_Device  * dev,
+                      int             code,
+                      AD013_Params  * params,
+                      AD013_ReplyFunc reply,
+                      void          * ctx,
+                      unsigned long   timeout) {
+
+  int len = 0;
+
+  if (!dev->reactor || dev->busy) return -1;
+
+  if ((len = AD013_BuildCmd(dev->cmd, code, params)) < 0) return -1;
+
+  dev->busy = true;
+  dev->code = AD013_CODE_OK;
+  dev->timeout = timeout;
+  dev->reply = reply;
+  dev->ctx = ctx;
+  dev->recv_len = 0;
+  dev->send_pos = -1;
+  dev->cmd_len = len;
+  dev->cmd_code = code;
+
+  // Slots written by the command (PS_StoreChar, PS_DeletChar, PS_Empty)
+  dev->slot_start = dev->slot_end = -1;
+  if (code == 0x06 && params && params->size >= 3) {
+    dev->slot_start = dev->slot_end = (uint8_t) params->buff[1] << 8 | (uint8_t) params->buff[2];
+  } else if (code == 0x0C && params && params->size >= 4) {
+    dev->slot_start = (uint8_t) params->buff[0] << 8 | (uint8_t) params->buff[1];
+    dev->slot_end = dev->slot_start + ((uint8_t) params->buff[2] << 8 | (uint8_t) params->buff[3]) - 1;
+  } else if (code == 0x0D) {
+    dev->slot_start = 0;
+    dev->slot_end = 0x7FFF;
+  }
+
+  // Data Packet Size being changed (PS_WriteReg 6)
+  dev->packet_next = 0;
+  if (code == 0x0E && params && params->size >= 2 && params->buff[0] == 6) {
+    dev->packet_next = 32 << (params->buff[1] & 0x03);
+  }
+
+  // The sensor is still processing an LED Command, the command
+  // is written when its ACK arrives (see AD013_DeviceFrame())
+  if (dev->led_acks == 0) {
+    // Replies to earlier (timed out) commands are dropped
+    AD013_ParserNext(&dev->parser);
+    if (AD013_DeviceWriteCmd(dev) < 0) {
+      dev->busy = false;
+      return -1;
+    }
+  }
+
+  AD013_TimerAdd(&dev->reactor->timers, &dev->timer, AD013_DeadlineIn(timeout));
+
+  return 1;
+}
+
+void AD013_DeviceComplete(AD013_Device * dev,
+                          int            code,
+                          const byte   * data,
+                          long           data_len) {
+
+  AD013_ReplyFunc reply = dev->reply;
+  void * ctx = dev->ctx;
+
+  if (dev->reactor) AD013_TimerCancel(&dev->reactor->timers, &dev->timer);
+
+  // The sensor is not answering, no LED ACKs are coming either
+  if (code == AD013_REACTOR_TIMEOUT) {
+    if (dev->reactor) AD013_TimerCancel(&dev->reactor->timers, &dev->led_timer);
+    dev->led_acks = 0;
+    dev->timeouts++;
+  }
+  dev->commands++;
+
+  // The slots' contents change (even if the command fails)
+  if (dev->slot_start >= 0 && dev->slot_end >= dev->slot_start) {
+    AD013_TemplateCacheBump(dev->slot_start, dev->slot_end);
+  }
+  dev->slot_start = dev->slot_end = -1;
+
+  // The device is free before the callback, so that the
+  // callback can send the next command
+  dev->busy = false;
+  dev->reply = NULL;
+  dev->ctx = NULL;
+  dev->sink = NULL;
+  dev->sink_ctx = NULL;
+  dev->send_buff = NULL;
+  dev->send_len = 0;
+  dev->send_pos = -1;
+  dev->cmd_len = 0;
+
+  if (reply) reply(dev, code, data, data_len, ctx);
+
+  // Queued Commands (unless the callback sent one)
+  AD013_DeviceNext(dev);
+
+  // Idle gap
+  if (!dev->busy && dev->led_len > 0 && dev->led_acks == 0) AD013_DeviceLedFlush(dev);
+}
+
+int AD013_DeviceFrame(AD013_Device * dev) {
+
+  const byte * data = AD013_ParserData(&dev->parser);
+  int data_len = AD013_ParserDataLen(&dev->parser);
+  int flag = AD013_ParserFlag(&dev->parser);
+
+  // ACKs of LED Commands (the sensor answers in order)
+  if (dev->led_acks > 0 && flag == AD013_PKT_FLAG_ACK) {
+    dev->led_acks--;
+    if (data_len < 1 || data[0] != AD013_CODE_OK) dev->led_errors++;
+    if (dev->led_acks > 0) return 0;
+    return AD013_DeviceLedIdle(dev);
+  }
+
+  // Unsolicited Frame
+  if (!dev->busy) return 0;
+
+  // Data Packets
+  if (flag == AD013_PKT_FLAG_DATA || flag == AD013_PKT_FLAG_DATA_END) {
+
+    if (!dev->sink) return 0;
+
+    // Once the sink failed, the rest of the packets are dropped
+    if (dev->code == AD013_CODE_OK) {
+      if (dev->sink(data, data_len, dev->sink_ctx) < 0) {
+        dev->code = AD013_REACTOR_IO_ERROR;
+      } else {
+        dev->recv_len += data_len;
+      }
+    }
+
+    if (flag == AD013_PKT_FLAG_DATA_END) {
+      AD013_DeviceComplete(dev, dev->code, NULL, dev->recv_len);
+      return 1;
+    }
+
+    // Each packet gets the full timeout
+    AD013_TimerAdd(&dev->reactor->timers, &dev->timer, AD013_DeadlineIn(dev->timeout));
+    return 0;
+  }
+
+  if (flag != AD013_PKT_FLAG_ACK || data_len < 1) return 0;
+
+  // Data packets follow a successful ACK
+  if (data[0] == AD013_CODE_OK && dev->sink) {
+    AD013_TimerAdd(&dev->reactor->timers, &dev->timer, AD013_DeadlineIn(dev->timeout));
+    return 0;
+  }
+
+  // Data packets are sent after a successful ACK (one packet per
+  // AD013_ReactorPoll(), see AD013_DeviceSendPacket())
+  if (data[0] == AD013_CODE_OK && dev->send_buff) {
+    dev->send_pos = 0;
+    return AD013_DeviceSendPacket(dev);
+  }
+
+  // Keeps the Data Packet Size of the sensor (PS_ReadSysPara, PS_WriteReg)
+  if (data[0] == AD013_CODE_OK && dev->cmd_code == 0x0F && data_len >= 15) {
+    dev->packet_size = 32 << (data[14] & 0x03);
+  } else if (data[0] == AD013_CODE_OK && dev->packet_next > 0) {
+    dev->packet_size = dev->packet_next;
+  }
+
+  AD013_DeviceComplete(dev, data[0], data + 1, data_len - 1);
+
+  return 1;
+}
+
+int AD013_DeviceSendPacket(AD013_Device * dev) {
+
+  AD013_FdStream port(dev->fd);
+  long len = 0;
+
+  len = AD013_SendPacket(port, dev->send_buff + dev->send_pos, dev->send_len - dev->send_pos,
+                         dev->packet_size);
+  if (len <= 0 || port.failed()) {
+    AD013_DeviceComplete(dev, AD013_REACTOR_IO_ERROR, NULL, 0);
+    return 1;
+  }
+
+  if ((dev->send_pos += len) >= dev->send_len) {
+    AD013_DeviceComplete(dev, AD013_CODE_OK, NULL, 0);
+    return 1;
+  }
+
+  // Each packet gets the full timeout
+  AD013_TimerAdd(&dev->reactor->timers, &dev->timer, AD013_DeadlineIn(dev->timeout));
+
+  return 0;
+}
+
+int AD013_DeviceSendJob(AD013_Device * dev, const AD013_DeviceJob * job) {
+
+  AD013_Params params = job->params;
+
+  if (job->data) {
+    return AD013_DeviceDownload(dev, job->code, job->has_params ? &params : NULL,
+                                job->data, job->data_len, job->reply, job->ctx, job->timeout);
+  }
+
+  return AD013_DeviceCommand(dev, job->code, job->has_params ? &params : NULL,
+                             job->reply, job->ctx, job->sink, job->sink_ctx, job->timeout);
+}
+
+int AD013_DeviceSchedule(AD013_Device * dev, int lane, const AD013_DeviceJob * job) {
+
+  int tail = 0;
+  int i = 0;
+
+  if (lane < 0 || lane >= AD013_LANES) return -1;
+
+  // Sent right away if nothing goes before it (e.g., from a reply
+  // callback, bulk commands still wait for the queued access ones)
+  for (i = 0; i <= lane && dev->job_count[i] == 0; i++);
+  if (!dev->busy && i > lane) return AD013_DeviceSendJob(dev, job);
+
+  if (dev->job_count[lane] >= AD013_DEVICE_QUEUE_SIZE) return -1;
+
+  tail = (dev->job_head[lane] + dev->job_count[lane]) % AD013_DEVICE_QUEUE_SIZE;
+  dev->jobs[lane][tail] = *job;
+  dev->job_count[lane]++;
+
+  return 1;
+}
+
+void AD013_DeviceNext(AD013_Device * dev) {
+
+  AD013_DeviceJob job;
+  int lane = 0;
+  int ret = -1;
+
+  while (!dev->busy) {
+
+    // Highest priority lane first
+    for (lane = 0; lane < AD013_LANES && dev->job_count[lane] == 0; lane++);
+    if (lane >= AD013_LANES) return;
+
+    job = dev->jobs[lane][dev->job_head[lane]];
+    dev->job_head[lane] = (dev->job_head[lane] + 1) % AD013_DEVICE_QUEUE_SIZE;
+    dev->job_count[lane]--;
+
+    // Cannot be sent, fails the command and goes on with the next
+    if ((ret = AD013_DeviceSendJob(dev, &job)) < 0 && job.reply) job.reply(dev, AD013_REACTOR_IO_ERROR, NULL, 0, job.ctx);
+  }
+}
+
+int AD013_DeviceLedFlush(AD013_Device * dev) {
+
+  AD013_FdStream port(dev->fd);
+  int len = dev->led_len;
+
+  if (!dev->reactor || len <= 0) return -1;
+
+  dev->led_len = 0;
+  if (port.write((byte *) dev->led_cmd, len) != (size_t) len || port.failed()) return -1;
+
+  dev->led_acks++;
+  dev->leds++;
+
+  // A lost ACK must not hold up the next command
+  AD013_TimerAdd(&dev->reactor->timers, &dev->led_timer, AD013_DeadlineIn(AD013_REACTOR_DEF_TIMEOUT));
+
+  return 1;
+}
+
+int AD013_DeviceLedIdle(AD013_Device * dev) {
+
+  if (dev->reactor) AD013_TimerCancel(&dev->reactor->timers, &dev->led_timer);
+
+  // The sensor is free again
+  if (dev->busy && dev->cmd_len > 0 && AD013_DeviceWriteCmd(dev) < 0) {
+    AD013_DeviceComplete(dev, AD013_REACTOR_IO_ERROR, NULL, 0);
+    return 1;
+  }
+  if (!dev->busy && dev->led_len > 0) AD013_DeviceLedFlush(dev);
+
+  return 0;
+}
+
+void AD013_DeviceWaitDone(AD013_Device * dev, int code) {
+
+  AD013_ReplyFunc reply = dev->wait_reply;
+  void * ctx = dev->wait_ctx;
+
+  if (dev->reactor) AD013_TimerCancel(&dev->reactor->timers, &dev->wait_timer);
+
+  // Free before the callback, which can wait again
+  dev->wait_reply = NULL;
+  dev->wait_ctx = NULL;
+
+  if (reply) reply(dev, code, NULL, 0, ctx);
+}
+
+int AD013_DeviceWriteCmd(AD013_Device * dev) {
+
+  AD013_FdStream port(dev->fd);
+  int len = dev->cmd_len;
+
+  dev->cmd_len = 0;
+  if (port.write((byte *) dev->cmd, len) != (size_t) len || port.failed()) return -1;
+
+  return 1;
+}
+
+                        // ========================
+                        // Reactor Public Functions
+                        // ========================
+
+int AD013_ReactorInit(AD013_Reactor * reactor) {
+
+  if (!reactor) return -1;
+
+  memset(reactor, 0, sizeof(AD013_Reactor));
+  AD013_TimerInit(&reactor->timers, millis());
+
+  if ((reactor->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    AD013_LOG_ERROR("Cannot Create epoll (errno %d)", errno);
+    return -1;
+  }
+
+  return 1;
+}
+
+void AD013_ReactorClose(AD013_Reactor * reactor) {
+
+  if (!reactor || reactor->epfd < 0) return;
+
+  while (reactor->count > 0) {
+    AD013_ReactorRemove(reactor, reactor->devices[reactor->count - 1]);
+  }
+
+  close(reactor->epfd);
+  reactor->epfd = -1;
+}
+
+int AD013_ReactorAdd(AD013_Reactor * reactor, AD013_Device * dev, int fd) {
+
+  struct epoll_event ev;
+  int flags = 0;
+
+  if (!reactor || !dev || fd < 0) return -1;
+  if (reactor->count >= AD013_REACTOR_MAX_DEVICES) return -1;
+
+  memset(dev, 0, sizeof(AD013_Device));
+  dev->fd = fd;
+  dev->timer.data = dev;
+  dev->wait_timer.data = dev;
+  dev->led_timer.data = dev;
+  dev->slot_start = dev->slot_end = -1;
+  dev->packet_size = 128;
+  AD013_ParserInit(&dev->parser);
+
+  if ((flags = fcntl(fd, F_GETFL)) < 0 ||
+      fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return -1;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = dev;
+  if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    AD013_LOG_ERROR("Cannot Add Device (errno %d)", errno);
+    return -1;
+  }
+
+  dev->reactor = reactor;
+  reactor->devices[reactor->count++] = dev;
+
+  return 1;
+}
+
+void AD013_ReactorRemove(AD013_Reactor * reactor, AD013_Device * dev) {
+
+  int i = 0;
+
+  if (!reactor || !dev || dev->reactor != reactor) return;
+
+  epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, dev->fd, NULL);
+  AD013_TimerCancel(&reactor->timers, &dev->timer);
+  AD013_TimerCancel(&reactor->timers, &dev->led_timer);
+
+  for (i = 0; i < reactor->count; i++) {
+    if (reactor->devices[i] == dev) {
+      reactor->devices[i] = reactor->devices[--reactor->count];
+      break;
+    }
+  }
+
+  dev->reactor = NULL;
+
+  // Pending wait, in-flight and queued commands fail
+  if (dev->wait_reply) AD013_DeviceWaitDone(dev, AD013_REACTOR_IO_ERROR);
+  if (dev->busy) {
+    AD013_DeviceComplete(dev, AD013_REACTOR_IO_ERROR, NULL, 0);
+  } else {
+    AD013_DeviceNext(dev);
+  }
+}
+
+int AD013_ReactorPoll(AD013_Reactor * reactor, int timeout) {
+
+  struct epoll_event events[AD013_REACTOR_MAX_DEVICES];
+  byte buff[AD013_REACTOR_READ_SIZE];
+  AD013_Device * dev = NULL;
+  AD013_Timer * timer = NULL;
+  long left = 0;
+  ssize_t len = 0;
+  int consumed = 0;
+  int done = 0;
+  int pos = 0;
+  int n = 0;
+  int i = 0;
+
+  if (!reactor || reactor->epfd < 0) return -1;
+
+  // Wakes up for the closest deadline
+  left = AD013_TimerNext(&reactor->timers, millis());
+  if (left >= 0 && (timeout < 0 || left < timeout)) timeout = left;
+
+  // Does not wait while data packets are to be sent
+  for (i = 0; i < reactor->count && timeout != 0; i++) {
+    if (reactor->devices[i]->busy && reactor->devices[i]->send_pos > 0) timeout = 0;
+  }
+
+  if ((n = epoll_wait(reactor->epfd, events, AD013_REACTOR_MAX_DEVICES, timeout)) < 0) {
+    if (errno == EINTR) return 0;
+    return -1;
+  }
+
+  reactor->wakeups++;
+
+  for (i = 0; i < n; i++) {
+
+    dev = (AD013_Device *) events[i].data.ptr;
+
+    // Reads everything the tty has (fewer wake-ups under load)
+    while (dev->reactor && (len = ::read(dev->fd, buff, sizeof(buff))) > 0) {
+      dev->bytes += len;
+      // Feeds the parser, one frame at a time
+      for (pos = 0; pos < len; pos += consumed) {
+        if (AD013_ParserFeed(&dev->parser, buff + pos, len - pos, &consumed)) {
+          done += AD013_DeviceFrame(dev);
+          AD013_ParserNext(&dev->parser);
+        }
+      }
+    }
+
+    // Hang-up or I/O Error
+    if (dev->reactor && (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR))) {
+      AD013_ReactorRemove(reactor, dev);
+      done++;
+    }
+  }
+
+  // Data Packets, one per device (long transfers take turns)
+  for (i = 0; i < reactor->count; i++) {
+    dev = reactor->devices[i];
+    if (dev->busy && dev->send_buff && dev->send_pos > 0) done += AD013_DeviceSendPacket(dev);
+  }
+
+  // Timed out Commands, Waits and LED ACKs
+  while ((timer = AD013_TimerExpired(&reactor->timers, millis())) != NULL) {
+    dev = (AD013_Device *) timer->data;
+    if (timer == &dev->wait_timer) {
+      AD013_DeviceWaitDone(dev, AD013_CODE_OK);
+    } else if (timer == &dev->led_timer) {
+      // The LED ACKs were lost, the sensor is taken as free
+      dev->led_errors += dev->led_acks;
+      dev->led_acks = 0;
+      AD013_DeviceLedIdle(dev);
+    } else {
+      AD013_DeviceComplete(dev, AD013_REACTOR_TIMEOUT, NULL, 0);
+    }
+    done++;
+  }
+
+  return done;
+}
+
+int AD013_DeviceCommand(AD013_Device  * dev,
+                        int             code,
+                        AD013_Params  * params,
+                        AD013_ReplyFunc reply,
+                        void          * ctx,
+                        AD013_DataSink  sink,
+                        void          * sink_ctx,
+                        unsigned long   timeout) {
+
+  if (!dev) return -1;
+
+  if (AD013_DeviceStart(dev, code, params, reply, ctx, timeout) < 0) return -1;
+
+  dev->sink = sink;
+  dev->sink_ctx = sink_ctx;
+
+  return 1;
+}
+
+int AD013_DeviceDownload(AD013_Device  * dev,
+                         int             code,
+                         AD013_Params  * params,
+                         const byte    * data,
+                         long            data_len,
+                         AD013_ReplyFunc reply,
+                         void          * ctx,
+                         unsigned long   timeout) {
+
+  if (!dev || !data || data_len <= 0) return -1;
+
+  if (AD013_DeviceStart(dev, code, params, reply, ctx, timeout) < 0) return -1;
+
+  dev->send_buff = data;
+  dev->send_len = data_len;
+
+  return 1;
+}
+
+int AD013_DeviceLed(AD013_Device * dev,
+                    int            mode,
+                    int            color,
+                    int            endColor,
+                    int            cycles) {
+
+  AD013_Params params = { };
+  int len = 0;
+
+  if (!dev || !dev->reactor) return -1;
+
+  if (AD013_LedParams(&params, mode, color, endColor, cycles) < 0) return -1;
+
+  // Replaces the queued LED Command (if any)
+  if ((len = AD013_BuildCmd(dev->led_cmd, 0x3C, &params)) < 0) return -1;
+  dev->led_len = len;
+
+  // Sent now if idle, in the next idle gap otherwise
+  if (!dev->busy && dev->led_acks == 0) return AD013_DeviceLedFlush(dev);
+
+  return 1;
+}
+
+int AD013_DeviceWait(AD013_Device  * dev,
+                     unsigned long   ms,
+                     AD013_ReplyFunc reply,
+                     void          * ctx) {
+
+  if (!dev || !dev->reactor || !reply || dev->wait_reply) return -1;
+
+  if (AD013_TimerAdd(&dev->reactor->timers, &dev->wait_timer, AD013_DeadlineIn(ms)) < 0) return -1;
+
+  dev->wait_reply = reply;
+  dev->wait_ctx = ctx;
+
+  return 1;
+}
+
+int AD013_DeviceSubmit(AD013_Device  * dev,
+                       int             lane,
+                       int             code,
+                       AD013_Params  * params,
+                       AD013_ReplyFunc reply,
+                       void          * ctx,
+                       AD013_DataSink  sink,
+                       void          * sink_ctx,
+                       unsigned long   timeout) {
+
+  AD013_DeviceJob job;
+
+  if (!dev || !dev->reactor) return -1;
+
+  memset(&job, 0, sizeof(job));
+  job.code = code;
+  if (params) {
+    job.params = *params;
+    job.has_params = true;
+  }
+  job.reply = reply;
+  job.ctx = ctx;
+  job.sink = sink;
+  job.sink_ctx = sink_ctx;
+  job.timeout = timeout;
+
+  return AD013_DeviceSchedule(dev, lane, &job);
+}
+
+int AD013_DeviceSubmitDownload(AD013_Device  * dev,
+                               int             lane,
+                               int             code,
+                               AD013_Params  * params,
+                               const byte    * data,
+                               long            data_len,
+                               AD013_ReplyFunc reply,
+                               void          * ctx,
+                               unsigned long   timeout) {
+
+  AD013_DeviceJob job;
+
+  if (!dev || !dev->reactor || !data || data_len <= 0) return -1;
+
+  memset(&job, 0, sizeof(job));
+  job.code = code;
+  if (params) {
+    job.params = *params;
+    job.has_params = true;
+  }
+  job.reply = reply;
+  job.ctx = ctx;
+  job.data = data;
+  job.data_len = data_len;
+  job.timeout = timeout;
+
+  return AD013_DeviceSchedule(dev, lane, &job);
+}
+
+int AD013_DeviceQueued(const AD013_Device * dev, int lane) {
+
+  if (!dev || lane < 0 || lane >= AD013_LANES) return -1;
+
+  return dev->job_count[lane];
+}
+
+#endif // AD013_HOST_BUILD
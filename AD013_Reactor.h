@@ -0,0 +1,280 @@
+#ifndef AD013_FINGERPRINT_REACTOR_HEADER
+#define AD013_FINGERPRINT_REACTOR_HEADER
+
+#include "AD013_Transport.h"
+#include "AD013_Timer.h"
+
+#ifdef AD013_HOST_BUILD
+
+// Sensors driven by one reactor
+#ifndef AD013_REACTOR_MAX_DEVICES
+#define AD013_REACTOR_MAX_DEVICES  64
+#endif
+
+// Default Command Timeout (ms)
+#define AD013_REACTOR_DEF_TIMEOUT  1000
+
+// Completion Codes (besides the sensor's Confirmation Codes)
+#define AD013_REACTOR_TIMEOUT      -1
+#define AD013_REACTOR_IO_ERROR     -2
+
+// Scheduler Lanes (see AD013_DeviceSubmit)
+#define AD013_LANE_ACCESS           0 /* Identify, Verify (always served first) */
+#define AD013_LANE_BULK             1 /* Backups, Sync, Index Reads */
+#define AD013_LANES                 2
+
+// Commands queued per lane
+#ifndef AD013_DEVICE_QUEUE_SIZE
+#define AD013_DEVICE_QUEUE_SIZE     8
+#endif
+
+struct device_st;
+
+/* !\brief Called when a command completes
+ *
+ * code is the Confirmation Code of the ACK, AD013_REACTOR_TIMEOUT or
+ * AD013_REACTOR_IO_ERROR. data points to the Data of the ACK (after the
+ * Confirmation Code) and is valid only during the call. For commands
+ * followed by data packets, data_len is the number of bytes passed to
+ * the sink instead.
+ */
+typedef void (*AD013_ReplyFunc)(struct device_st * dev,
+                                int                code,
+                                const byte       * data,
+                                long               data_len,
+                                void             * ctx);
+
+// Queued Command
+typedef struct device_job_st {
+  int                 code;
+  AD013_Params        params;
+  bool                has_params;
+  AD013_ReplyFunc     reply;
+  void              * ctx;
+  AD013_DataSink      sink;
+  void              * sink_ctx;
+  const byte        * data;        /* Data packets (PS_DownChar) */
+  long                data_len;
+  unsigned long       timeout;
+} AD013_DeviceJob;
+
+// Sensor attached to a reactor (one in-flight command at a time)
+typedef struct device_st {
+  int                 fd;
+  struct reactor_st * reactor;
+  AD013_Parser        parser;
+
+  // In-flight Command
+  bool                busy;
+  int                 code;        /* Confirmation Code (data transfers) */
+  AD013_Timer         timer;       /* Command Deadline */
+  unsigned long       timeout;     /* Per-packet Timeout (ms) */
+  AD013_ReplyFunc     reply;
+  void              * ctx;
+  char                cmd[AD013_MAX_CMD_SIZE];
+  int                 cmd_len;     /* Waiting for an LED ACK (0: written) */
+  int                 cmd_code;    /* Instruction Code */
+  int                 slot_start;  /* Slots stored/deleted (-1: none) */
+  int                 slot_end;
+
+  // Statistics
+  unsigned long       commands;    /* Completed Commands */
+  unsigned long       timeouts;    /* Timed out Commands */
+  unsigned long       bytes;       /* Received Bytes */
+  unsigned long       leds;        /* Sent LED Commands */
+  unsigned long       led_errors;  /* Rejected LED Commands */
+
+  // LED Command (only sent when idle)
+  char                led_cmd[AD013_MAX_CMD_SIZE];
+  int                 led_len;     /* Pending (0: none) */
+  int                 led_acks;    /* ACKs of sent LED Commands still due */
+  AD013_Timer         led_timer;   /* LED ACK Deadline */
+
+  // Wait (see AD013_DeviceWait)
+  AD013_Timer         wait_timer;
+  AD013_ReplyFunc     wait_reply;
+  void              * wait_ctx;
+
+  // Data Transfers
+  int                 packet_size; /* Sensor's Data Packet Size (bytes) */
+  int                 packet_next; /* Size being written (PS_WriteReg, 0: none) */
+  AD013_DataSink      sink;        /* Data packets (PS_UpChar, PS_UpImage) */
+  void              * sink_ctx;
+  long                recv_len;
+  const byte        * send_buff;   /* Data packets (PS_DownChar) */
+  long                send_len;
+  long                send_pos;    /* Bytes sent (-1: waiting for the ACK) */
+
+  // Scheduler
+  AD013_DeviceJob     jobs[AD013_LANES][AD013_DEVICE_QUEUE_SIZE];
+  int                 job_head[AD013_LANES];
+  int                 job_count[AD013_LANES];
+} AD013_Device;
+
+// Reactor (epoll)
+//
+// Each device's command deadline is a timer in the reactor's timer
+// queue, so arming, cancelling and expiring them does not depend on
+// the number of devices.
+typedef struct reactor_st {
+  int              epfd;
+  int              count;
+  AD013_Device   * devices[AD013_REACTOR_MAX_DEVICES];
+  AD013_TimerQueue timers;
+  unsigned long    wakeups;        /* Returns from epoll_wait() */
+} AD013_Reactor;
+
+
+/* !\brief Initializes a reactor
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_ReactorInit(AD013_Reactor * reactor);
+
+/* !\brief Releases the reactor's resources (the devices' fds are not closed) */
+void AD013_ReactorClose(AD013_Reactor * reactor);
+
+/* !\brief Attaches a sensor, reachable via the tty fd, to the reactor
+ *
+ * The fd is switched to non-blocking mode. Use AD013_TtyBaud() to set
+ * the port speed beforehand.
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_ReactorAdd(AD013_Reactor * reactor, AD013_Device * dev, int fd);
+
+/* !\brief Detaches a sensor from the reactor
+ *
+ * An in-flight command completes with AD013_REACTOR_IO_ERROR.
+ */
+void AD013_ReactorRemove(AD013_Reactor * reactor, AD013_Device * dev);
+
+/* !\brief Waits up to timeout ms for the attached sensors
+ *
+ * Received bytes are fed to each device's frame parser, completed and
+ * timed out commands are dispatched to their reply callbacks.
+ *
+ * The function returns the number of dispatched completions or -1 if any
+ * error occurs.
+ */
+int AD013_ReactorPoll(AD013_Reactor * reactor, int timeout);
+
+/* !\brief Sends a command to the sensor (non-blocking)
+ *
+ * reply is called from AD013_ReactorPoll() with the ACK. For commands
+ * followed by data packets (PS_UpChar, PS_UpImage), pass a sink: the
+ * reply is then called after the last packet.
+ *
+ * The command bypasses the scheduler's queues (see AD013_DeviceSubmit()).
+ * When a PS_StoreChar, PS_DeletChar or PS_Empty completes, the slots it
+ * wrote are bumped in the Template Cache (see AD013_TemplateCacheBump()).
+ *
+ * The function returns 1 in case of success and -1 if the device is busy
+ * or the command cannot be sent.
+ */
+int AD013_DeviceCommand(AD013_Device  * dev,
+                        int             code,
+                        AD013_Params  * params,
+                        AD013_ReplyFunc reply,
+                        void          * ctx,
+                        AD013_DataSink  sink     = NULL,
+                        void          * sink_ctx = NULL,
+                        unsigned long   timeout  = AD013_REACTOR_DEF_TIMEOUT);
+
+/* !\brief Sends a command followed by data packets (non-blocking)
+ *
+ * Use this function for PS_DownChar: the data is sent once the sensor
+ * accepts the command and must stay valid until reply is called. One
+ * data packet is sent per AD013_ReactorPoll(), so that a long transfer
+ * does not hold up the other devices. Packets are sized by the device's
+ * packet_size (128 unless a PS_ReadSysPara or a PS_WriteReg of the
+ * packet size went through the device).
+ *
+ * The function returns 1 in case of success and -1 if the device is busy
+ * or the command cannot be sent.
+ */
+int AD013_DeviceDownload(AD013_Device  * dev,
+                         int             code,
+                         AD013_Params  * params,
+                         const byte    * data,
+                         long            data_len,
+                         AD013_ReplyFunc reply,
+                         void          * ctx,
+                         unsigned long   timeout = AD013_REACTOR_DEF_TIMEOUT);
+
+/* !\brief Queues a command in one of the scheduler's lanes (non-blocking)
+ *
+ * Commands wait in their lane until the device is free. Commands of the
+ * AD013_LANE_ACCESS lane (e.g., identification) always go before the
+ * ones of the AD013_LANE_BULK lane (e.g., Template backups), so that the
+ * wait for a person at the door is bounded by the command (or transfer)
+ * in flight. Split bulk work into single commands to keep it short.
+ *
+ * The parameters are those of AD013_DeviceCommand() (params are copied).
+ *
+ * The function returns 1 in case of success and -1 if the lane is full
+ * or the command cannot be sent.
+ */
+int AD013_DeviceSubmit(AD013_Device  * dev,
+                       int             lane,
+                       int             code,
+                       AD013_Params  * params,
+                       AD013_ReplyFunc reply,
+                       void          * ctx,
+                       AD013_DataSink  sink     = NULL,
+                       void          * sink_ctx = NULL,
+                       unsigned long   timeout  = AD013_REACTOR_DEF_TIMEOUT);
+
+/* !\brief Queues a command followed by data packets (non-blocking)
+ *
+ * Same as AD013_DeviceSubmit() for AD013_DeviceDownload() commands.
+ */
+int AD013_DeviceSubmitDownload(AD013_Device  * dev,
+                               int             lane,
+                               int             code,
+                               AD013_Params  * params,
+                               const byte    * data,
+                               long            data_len,
+                               AD013_ReplyFunc reply,
+                               void          * ctx,
+                               unsigned long   timeout = AD013_REACTOR_DEF_TIMEOUT);
+
+/* !\brief Returns the number of commands queued in a lane */
+int AD013_DeviceQueued(const AD013_Device * dev, int lane);
+
+/* !\brief Sets the sensor's LED (non-blocking)
+ *
+ * The module handles one command at a time, so the LED command is only
+ * written when the device is idle: right away, or else in the first
+ * idle gap after the in-flight and queued commands. Only the latest LED
+ * setting is kept while queued. Its ACK is absorbed by the device (see
+ * led_errors); a command started before that ACK is written once it
+ * arrives, or once AD013_REACTOR_DEF_TIMEOUT passes without it (counted
+ * in led_errors). See AD013_LedParams() for the parameters.
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_DeviceLed(AD013_Device * dev,
+                    int            mode,
+                    int            color    = AD013_LED_BLUE,
+                    int            endColor = -1,
+                    int            cycles   = 0);
+
+/* !\brief Calls reply after ms, without sending anything (non-blocking)
+ *
+ * Use this function to pace polling commands (e.g., PS_GetImage while
+ * waiting for a finger) without blocking the other devices. reply is
+ * called from AD013_ReactorPoll() with AD013_CODE_OK, or with
+ * AD013_REACTOR_IO_ERROR if the device is removed first. One wait per
+ * device at a time.
+ *
+ * The function returns 1 in case of success and -1 if any error occurs.
+ */
+int AD013_DeviceWait(AD013_Device  * dev,
+                     unsigned long   ms,
+                     AD013_ReplyFunc reply,
+                     void          * ctx);
+
+#endif // AD013_HOST_BUILD
+
+#endif // AD013_FINGERPRINT_REACTOR_HEADER
@@ -0,0 +1,191 @@
+
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Fingerprint / RFID / BLE Project
+// ================================================
+
+// Local Include
+#include "AD013_Timer.h"
+
+#ifdef AD013_HOST_BUILD
+
+// Global Definitions
+#define AD013_WHEEL_MASK          (AD013_WHEEL_SLOTS - 1)
+#define AD013_WHEEL_MASK_HI       (AD013_WHEEL_SLOTS_HI - 1)
+
+                        // =============================
+                        // Internal Functions Prototypes
+                        // =============================
+
+void AD013_TimerLink(AD013_Timer * head, AD013_Timer * timer);
+void AD013_TimerUnlink(AD013_Timer * timer);
+void AD013_TimerPlace(AD013_TimerQueue * queue, AD013_Timer * timer);
+void AD013_TimerCascade(AD013_TimerQueue * queue);
+
+                        // =========================
+                        // Timer Wheel (Host Builds)
+                        // =========================
+
+void AD013_TimerLink(AD013_Timer * head, AD013_Timer * timer) {
+
+  timer->next = head;
+  timer->prev = head->prev;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+void AD013_TimerUnlink(AD013_Timer * timer) {
+
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next = timer->prev = NULL;
+}
+
+void AD013_TimerPlace(AD013_TimerQueue * queue, AD013_Timer * timer) {
+
+  unsigned long tick = timer->deadline / AD013_WHEEL_TICK;
+  long ahead = (long)(tick - queue->tick);
+
+  if (ahead < AD013_WHEEL_SLOTS) {
+    // Within the first level (past deadlines expire on the next tick)
+    if (ahead < 0) tick = queue->tick;
+    AD013_TimerLink(&queue->slots[tick & AD013_WHEEL_MASK], timer);
+  } else {
+    // Cascaded into the first level when its turn comes (timers
+    // further than the whole wheel just go around once more)
+    AD013_TimerLink(&queue->slots_hi[(tick >> AD013_WHEEL_BITS) & AD013_WHEEL_MASK_HI], timer);
+  }
+}
+
+void AD013_TimerCascade(AD013_TimerQueue * queue) {
+
+  AD013_Timer * head = &queue->slots_hi[(queue->tick >> AD013_WHEEL_BITS) & AD013_WHEEL_MASK_HI];
+  AD013_Timer list;
+  AD013_Timer * timer = NULL;
+
+  if (head->next == head) return;
+
+  // Detaches the whole slot, then places each timer again
+  list.next = head->next;
+  list.prev = head->prev;
+  list.next->prev = &list;
+  list.prev->next = &list;
+  head->next = head->prev = head;
+
+  while ((timer = list.next) != &list) {
+    AD013_TimerUnlink(timer);
+    AD013_TimerPlace(queue, timer);
+  }
+}
+
+                        // =====================
+                        // Timer Queue Functions
+                        // =====================
+
+void AD013_TimerInit(AD013_TimerQueue * queue, unsigned long now) {
+
+  if (!queue) return;
+
+  for (int i = 0; i < AD013_WHEEL_SLOTS; i++) {
+    queue->slots[i].next = queue->slots[i].prev = &queue->slots[i];
+  }
+  for (int i = 0; i < AD013_WHEEL_SLOTS_HI; i++) {
+    queue->slots_hi[i].next = queue->slots_hi[i].prev = &queue->slots_hi[i];
+  }
+
+  queue->tick = now / AD013_WHEEL_TICK;
+  queue->count = 0;
+}
+
+int AD013_TimerAdd(AD013_TimerQueue * queue, AD013_Timer * timer, unsigned long deadline) {
+
+  if (AD013_TimerArmed(timer)) AD013_TimerCancel(queue, timer);
+
+  timer->deadline = deadline;
+  AD013_TimerPlace(queue, timer);
+  queue->count++;
+
+  return 1;
+}
+
+void AD013_TimerCancel(AD013_TimerQueue * queue, AD013_Timer * timer) {
+
+  if (!AD013_TimerArmed(timer)) return;
+
+  AD013_TimerUnlink(timer);
+  queue->count--;
+}
+
+AD013_Timer * AD013_TimerExpired(AD013_TimerQueue * queue, unsigned long now) {
+
+  AD013_Timer * head = NULL;
+  AD013_Timer * timer = NULL;
+  unsigned long last = now / AD013_WHEEL_TICK;
+
+  while ((long)(last - queue->tick) >= 0) {
+
+    if (queue->count == 0) {
+      queue->tick = last;
+      break;
+    }
+
+    head = &queue->slots[queue->tick & AD013_WHEEL_MASK];
+
+    for (timer = head->next; timer != head; timer = timer->next) {
+      if ((long)(now - timer->deadline) >= 0) {
+        AD013_TimerCancel(queue, timer);
+        return timer;
+      }
+    }
+
+    // Only the current tick can still receive expired timers
+    if (queue->tick == last) break;
+
+    // Brings the next second-level slot down
+    if ((++queue->tick & AD013_WHEEL_MASK) == 0) AD013_TimerCascade(queue);
+  }
+
+  return NULL;
+}
+
+long AD013_TimerNext(const AD013_TimerQueue * queue, unsigned long now) {
+
+  const AD013_Timer * head = NULL;
+  const AD013_Timer * timer = NULL;
+  unsigned long block = 0;
+  long next = -1;
+  long left = 0;
+  int i = 0;
+
+  if (queue->count == 0) return -1;
+
+  // Closest non-empty slot of the first level...
+  for (i = 0; i < AD013_WHEEL_SLOTS && next < 0; i++) {
+    head = &queue->slots[(queue->tick + i) & AD013_WHEEL_MASK];
+    for (timer = head->next; timer != head; timer = timer->next) {
+      left = (long)(timer->deadline - now);
+      if (left < 0) left = 0;
+      if (next < 0 || left < next) next = left;
+    }
+  }
+
+  // ... and the start of the closest non-empty slot of the second
+  // level: its timers are not due earlier and are cascaded into the
+  // first level by then, so they are never walked here
+  for (i = 1; i <= AD013_WHEEL_SLOTS_HI; i++) {
+    block = (queue->tick >> AD013_WHEEL_BITS) + i;
+    head = &queue->slots_hi[block & AD013_WHEEL_MASK_HI];
+    if (head->next == head) continue;
+    left = (long)(block * AD013_WHEEL_SLOTS * AD013_WHEEL_TICK - now);
+    if (left < 0) left = 0;
+    if (next < 0 || left < next) next = left;
+    break;
+  }
+
+  return next;
+}
+
+#endif // AD013_HOST_BUILD
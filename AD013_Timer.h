@@ -0,0 +1,83 @@
+#ifndef AD013_FINGERPRINT_TIMER_HEADER
+#define AD013_FINGERPRINT_TIMER_HEADER
+
+#include "AD013.h"
+
+// Absolute Deadlines
+//
+// Every command carries an absolute deadline (in millis()) instead of
+// a relative timeout, so checking it is a single (wrap-around safe)
+// comparison no matter how many reads or retries happen in between.
+
+/* !\brief Returns the deadline ms from now */
+#define AD013_DeadlineIn(ms) \
+  (millis() + (unsigned long)(ms))
+
+/* !\brief Returns the ms left before the deadline (<= 0 if passed) */
+#define AD013_DeadlineLeft(d) \
+  ((long)((unsigned long)(d) - millis()))
+
+/* !\brief Returns true if the deadline has passed */
+#define AD013_DeadlinePassed(d) \
+  (AD013_DeadlineLeft(d) <= 0)
+
+// Timer Queue (Host Builds)
+//
+// Keeps the deadlines of many in-flight commands (one per reactor
+// device) in a hierarchical timer wheel: adding, cancelling and
+// expiring a timer take constant time regardless of the number of
+// timers. The blocking functions used on MCUs wait for a single
+// command at a time and only need the deadlines above.
+
+#ifdef AD013_HOST_BUILD
+
+// Wheel Resolution (ms per tick) and Size (slots per level)
+#ifndef AD013_WHEEL_TICK
+#define AD013_WHEEL_TICK             4
+#endif
+
+#define AD013_WHEEL_BITS             8
+#define AD013_WHEEL_SLOTS          (1 << AD013_WHEEL_BITS)
+#define AD013_WHEEL_SLOTS_HI        64
+
+// Timer (embedded in the object that owns the deadline)
+typedef struct timer_st {
+  struct timer_st * next;
+  struct timer_st * prev;
+  unsigned long     deadline;  /* millis() */
+  void            * data;      /* Owner */
+} AD013_Timer;
+
+typedef struct timer_queue_st {
+  AD013_Timer   slots[AD013_WHEEL_SLOTS];        /* Next AD013_WHEEL_SLOTS ticks */
+  AD013_Timer   slots_hi[AD013_WHEEL_SLOTS_HI]; /* Later, AD013_WHEEL_SLOTS ticks each */
+  unsigned long tick;                            /* Next tick to expire */
+  int           count;                           /* Armed Timers */
+} AD013_TimerQueue;
+
+
+/* !\brief Initializes an (empty) timer queue starting at now */
+void AD013_TimerInit(AD013_TimerQueue * queue, unsigned long now);
+
+/* !\brief Arms a timer to expire at deadline (re-arms it if armed)
+ *
+ * The function returns 1.
+ */
+int AD013_TimerAdd(AD013_TimerQueue * queue, AD013_Timer * timer, unsigned long deadline);
+
+/* !\brief Disarms a timer (nothing happens if the timer is not armed) */
+void AD013_TimerCancel(AD013_TimerQueue * queue, AD013_Timer * timer);
+
+/* !\brief Returns true if the timer is armed */
+#define AD013_TimerArmed(t) \
+  ((t)->next != NULL)
+
+/* !\brief Returns the next expired timer (disarmed) or NULL if none */
+AD013_Timer * AD013_TimerExpired(AD013_TimerQueue * queue, unsigned long now);
+
+/* !\brief Returns the ms until the next timer expires (-1 if none) */
+long AD013_TimerNext(const AD013_TimerQueue * queue, unsigned long now);
+
+#endif // AD013_HOST_BUILD
+
+#endif // AD013_FINGERPRINT_TIMER_HEADER
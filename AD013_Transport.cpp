@@ -0,0 +1,320 @@
+
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Fingerprint / RFID / BLE Project
+// ================================================
+
+// Local Include
+#include "AD013_Transport.h"
+
+// Global Definitions
+#define AD013_RING_MASK           (AD013_RING_SIZE - 1)
+
+// Byte at offset 'a' from the ring's index 'b'
+#define AD013_RING_AT(r, b, a) \
+  ((r)->buff[((b) + (a)) & AD013_RING_MASK])
+
+// AD013_RingStreams in use (see AD013_RingStreamOf())
+static AD013_RingStream * AD013_RingStreams = NULL;
+
+// Orders the accesses to the ring's data and indexes (single
+// core MCUs only need the compiler not to reorder them)
+#if defined(__AVR__)
+#define AD013_RING_BARRIER() \
+  __asm__ __volatile__ ("" ::: "memory")
+#else
+#define AD013_RING_BARRIER() \
+  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+                        // ======================
+                        // Receive Ring Functions
+                        // ======================
+
+void AD013_RingInit(AD013_Ring * ring) {
+
+  if (!ring) return;
+
+  ring->head = 0;
+  ring->tail = 0;
+  ring->overruns = 0;
+}
+
+bool AD013_RingPush(AD013_Ring * ring, byte c) {
+
+  AD013_RingIndex head = ring->head;
+  AD013_RingIndex next = (head + 1) & AD013_RING_MASK;
+
+  // Full, the byte is lost
+  if (next == ring->tail) {
+    ring->overruns = ring->overruns + 1;
+    return false;
+  }
+
+  // Data first, then the index
+  ring->buff[head] = c;
+  AD013_RING_BARRIER();
+  ring->head = next;
+
+  return true;
+}
+
+int AD013_RingWrite(AD013_Ring * ring, const byte * data, int data_len) {
+
+  AD013_RingIndex head = ring->head;
+  AD013_RingIndex tail = ring->tail;
+  int room = (tail - head - 1) & AD013_RING_MASK;
+  int len = data_len < room ? data_len : room;
+
+  for (int i = 0; i < len; i++) {
+    ring->buff[head] = data[i];
+    head = (head + 1) & AD013_RING_MASK;
+  }
+
+  if (len < data_len) ring->overruns = ring->overruns + (data_len - len);
+
+  // Publishes the whole block at once
+  AD013_RING_BARRIER();
+  ring->head = head;
+
+  return len;
+}
+
+int AD013_RingAvailable(const AD013_Ring * ring) {
+  return (ring->head - ring->tail) & AD013_RING_MASK;
+}
+
+int AD013_RingPop(AD013_Ring * ring) {
+
+  AD013_RingIndex tail = ring->tail;
+  int c = -1;
+
+  if (tail == ring->head) return -1;
+
+  // Data first, then the index
+  AD013_RING_BARRIER();
+  c = ring->buff[tail];
+  AD013_RING_BARRIER();
+  ring->tail = (tail + 1) & AD013_RING_MASK;
+
+  return c;
+}
+
+AD013_RingStream::AD013_RingStream(AD013_Ring * ring, Print & tx) : _ring(ring), _tx(tx) {
+
+  AD013_ParserInit(&_parser);
+
+  _next = AD013_RingStreams;
+  AD013_RingStreams = this;
+}
+
+AD013_RingStream::~AD013_RingStream() {
+
+  AD013_RingStream ** link = &AD013_RingStreams;
+
+  while (*link && *link != this) link = &(*link)->_next;
+  if (*link) *link = _next;
+}
+
+AD013_RingStream * AD013_RingStreamOf(Stream & SensorCom) {
+
+  AD013_RingStream * ringCom = AD013_RingStreams;
+
+  // Only the addresses are compared (no RTTI on the MCUs)
+  while (ringCom && (Stream *) ringCom != &SensorCom) ringCom = ringCom->_next;
+
+  return ringCom;
+}
+
+int AD013_RingStream::peek() {
+
+  if (_ring->tail == _ring->head) return -1;
+
+  AD013_RING_BARRIER();
+  return _ring->buff[_ring->tail];
+}
+
+                        // ======================
+                        // Frame Parser Functions
+                        // ======================
+
+void AD013_ParserInit(AD013_Parser * parser) {
+
+  if (!parser) return;
+
+  parser->state = AD013_PARSER_SYNC;
+  parser->pos = 0;
+  parser->len = 0;
+  parser->sum = 0;
+  parser->errors = 0;
+}
+
+void AD013_ParserNext(AD013_Parser * parser) {
+
+  parser->state = AD013_PARSER_SYNC;
+  parser->pos = 0;
+  parser->len = 0;
+  parser->sum = 0;
+}
+
+int AD013_ParserFeed(AD013_Parser * parser,
+                     const byte   * data,
+                     int            data_len,
+                     int          * consumed) {
+
+  int i = 0;
+  byte c = 0;
+
+  for (i = 0; i < data_len && parser->state != AD013_PARSER_DONE; i++) {
+
+    c = data[i];
+
+    switch (parser->state) {
+
+      case AD013_PARSER_SYNC: {
+        // Header is 0xEF 0x01
+        if (parser->pos == 0 && c == 0xEF) {
+          parser->frame[parser->pos++] = c;
+        } else if (parser->pos == 1 && c == 0x01) {
+          parser->frame[parser->pos++] = c;
+          parser->state = AD013_PARSER_HEADER;
+        } else {
+          parser->pos = (c == 0xEF ? 1 : 0);
+        }
+      } break;
+
+      case AD013_PARSER_HEADER: {
+        parser->frame[parser->pos++] = c;
+        if (parser->pos > AD013_MSG_OFFSET_FLAG) parser->sum += c;
+        if (parser->pos < AD013_MSG_OFFSET_CODE) break;
+
+        // Length covers the Code/Data and the Sum
+        parser->len = AD013_MSG_OFFSET_CODE +
+          ((uint16_t) parser->frame[AD013_MSG_OFFSET_LENGTH] << 8 |
+                      parser->frame[AD013_MSG_OFFSET_LENGTH + 1]);
+        if (parser->len < AD013_MSG_OFFSET_CODE + 3 ||
+            parser->len > AD013_MAX_FRAME_SIZE) {
+          parser->errors++;
+          AD013_ParserNext(parser);
+        } else {
+          parser->state = AD013_PARSER_BODY;
+        }
+      } break;
+
+      case AD013_PARSER_BODY: {
+        parser->frame[parser->pos++] = c;
+        if (parser->pos <= parser->len - 2) parser->sum += c;
+        if (parser->pos < parser->len) break;
+
+        // Compares the Checksums
+        if (parser->sum == ((uint16_t) parser->frame[parser->len - 2] << 8 |
+                                       parser->frame[parser->len - 1])) {
+          parser->state = AD013_PARSER_DONE;
+        } else {
+          parser->errors++;
+          AD013_ParserNext(parser);
+        }
+      } break;
+    }
+  }
+
+  if (consumed) *consumed = i;
+
+  return parser->state == AD013_PARSER_DONE ? 1 : 0;
+}
+
+int AD013_ParserDrain(AD013_Parser * parser, AD013_Ring * ring) {
+
+  int c = -1;
+  byte b = 0;
+
+  while (parser->state != AD013_PARSER_DONE && (c = AD013_RingPop(ring)) >= 0) {
+    b = (byte) c;
+    AD013_ParserFeed(parser, &b, 1);
+  }
+
+  return parser->state == AD013_PARSER_DONE ? 1 : 0;
+}
+
+int AD013_ParserPeek(AD013_Parser    * parser,
+                     AD013_Ring      * ring,
+                     AD013_FrameView * view) {
+
+  AD013_RingIndex tail = 0;
+  const byte * frame = NULL;
+  int avail = 0;
+  int first = 0;
+  uint16_t len = 0;
+  uint16_t sum = 0;
+
+  for (;;) {
+
+    tail = ring->tail;
+    avail = AD013_RingAvailable(ring);
+    AD013_RING_BARRIER();
+
+    // Drops anything before the Header (0xEF 0x01)
+    if (avail >= 2 && (AD013_RING_AT(ring, tail, 0) != 0xEF ||
+                       AD013_RING_AT(ring, tail, 1) != 0x01)) {
+      ring->tail = (tail + 1) & AD013_RING_MASK;
+      continue;
+    }
+
+    if (avail < AD013_MSG_OFFSET_CODE) return 0;
+
+    // Length covers the Code/Data and the Sum
+    len = AD013_MSG_OFFSET_CODE +
+      ((uint16_t) AD013_RING_AT(ring, tail, AD013_MSG_OFFSET_LENGTH) << 8 |
+                  AD013_RING_AT(ring, tail, AD013_MSG_OFFSET_LENGTH + 1));
+    if (len < AD013_MSG_OFFSET_CODE + 3 || len > AD013_MAX_FRAME_SIZE) {
+      parser->errors++;
+      ring->tail = (tail + 1) & AD013_RING_MASK;
+      continue;
+    }
+
+    if (avail < len) return 0;
+
+    if (tail + len <= AD013_RING_SIZE) {
+      // In place, the frame is contiguous
+      frame = ring->buff + tail;
+      sum = AD013_Sum(0, frame + AD013_MSG_OFFSET_FLAG,
+                      len - 2 - AD013_MSG_OFFSET_FLAG);
+    } else {
+      // Wraps around the end of the ring, the checksum is computed
+      // while copying (then Header, DevId and Sum are taken out)
+      first = AD013_RING_SIZE - tail;
+      sum = AD013_CopySum(0, parser->frame, ring->buff + tail, first);
+      sum = AD013_CopySum(sum, parser->frame + first, ring->buff, len - first);
+      frame = parser->frame;
+      sum -= AD013_Sum(0, frame, AD013_MSG_OFFSET_FLAG);
+      sum -= AD013_Sum(0, frame + len - 2, 2);
+    }
+
+    if (sum != ((uint16_t) frame[len - 2] << 8 | frame[len - 1])) {
+      parser->errors++;
+      ring->tail = (tail + 1) & AD013_RING_MASK;
+      continue;
+    }
+
+    break;
+  }
+
+  view->data = frame + AD013_MSG_OFFSET_CODE;
+  view->len = len - AD013_MSG_OFFSET_CODE - 2;
+  view->flag = frame[AD013_MSG_OFFSET_FLAG];
+  view->frame_len = len;
+
+  return 1;
+}
+
+void AD013_ParserRelease(AD013_Parser          * /* parser */,
+                         AD013_Ring            * ring,
+                         const AD013_FrameView * view) {
+
+  // The slots go back to the producer
+  AD013_RING_BARRIER();
+  ring->tail = (ring->tail + view->frame_len) & AD013_RING_MASK;
+}
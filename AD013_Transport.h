@@ -0,0 +1,216 @@
+#ifndef AD013_FINGERPRINT_TRANSPORT_HEADER
+#define AD013_FINGERPRINT_TRANSPORT_HEADER
+
+#include "AD013.h"
+
+// Receive Ring Size (power of 2)
+#ifndef AD013_RING_SIZE
+#ifdef AD013_HOST_BUILD
+#define AD013_RING_SIZE         4096
+#else
+#define AD013_RING_SIZE          256
+#endif
+#endif
+
+#if (AD013_RING_SIZE & (AD013_RING_SIZE - 1)) != 0
+#error "AD013_RING_SIZE must be a power of 2"
+#endif
+
+// Ring indexes must be read/written atomically by the MCU
+#if defined(__AVR__)
+#if AD013_RING_SIZE > 256
+#error "AD013_RING_SIZE cannot exceed 256 on AVR"
+#endif
+typedef uint8_t  AD013_RingIndex;
+#else
+typedef uint16_t AD013_RingIndex;
+#endif
+
+// Largest frame handled by the parser (header, payload and sum)
+#define AD013_MAX_FRAME_SIZE  (AD013_MSG_OFFSET_CODE + AD013_MAX_PACKET_SIZE + 2)
+
+// The ring must hold a whole frame (one slot is kept free), or
+// AD013_ParserPeek() would never find one
+#if AD013_MAX_FRAME_SIZE >= AD013_RING_SIZE
+#error "AD013_RING_SIZE must be larger than AD013_MAX_FRAME_SIZE"
+#endif
+
+// Single-Producer / Single-Consumer Receive Ring
+//
+// The producer (UART RX interrupt or DMA completion) only writes
+// 'head', the consumer (the frame parser) only writes 'tail', so
+// no locking is needed. One slot is kept free to tell a full ring
+// from an empty one.
+typedef struct ring_st {
+  byte                     buff[AD013_RING_SIZE];
+  volatile AD013_RingIndex head;     /* Next slot to write (producer) */
+  volatile AD013_RingIndex tail;     /* Next slot to read (consumer) */
+  volatile uint16_t        overruns; /* Bytes dropped (ring full) */
+} AD013_Ring;
+
+// Parser States
+typedef enum {
+  AD013_PARSER_SYNC = 0,  /* Looking for the 0xEF 0x01 Header */
+  AD013_PARSER_HEADER,    /* Reading DevId, Flag and Length */
+  AD013_PARSER_BODY,      /* Reading Code/Data and Sum */
+  AD013_PARSER_DONE       /* A valid frame is available */
+} AD013_PARSER_STATE;
+
+// Incremental Frame Parser
+typedef struct parser_st {
+  uint8_t  state;
+  uint16_t pos;           /* Bytes of the current frame */
+  uint16_t len;           /* Frame Size (from the Length field) */
+  uint16_t sum;           /* Running Checksum */
+  uint16_t errors;        /* Dropped Frames (checksum, length) */
+  byte     frame[AD013_MAX_FRAME_SIZE];
+} AD013_Parser;
+
+// View of a received frame
+typedef struct frame_view_st {
+  const byte * data;      /* Code/Data of the frame */
+  int          len;       /* Size of the Code/Data */
+  uint8_t      flag;      /* Packet Identifier */
+  uint16_t     frame_len; /* Bytes taken in the ring */
+} AD013_FrameView;
+
+
+/* !\brief Initializes (empties) a receive ring */
+void AD013_RingInit(AD013_Ring * ring);
+
+/* !\brief Adds one received byte to the ring (producer side)
+ *
+ * Call this function from the UART RX interrupt handler. The function
+ * returns false (and counts an overrun) when the ring is full.
+ */
+bool AD013_RingPush(AD013_Ring * ring, byte c);
+
+/* !\brief Adds a block of received bytes to the ring (producer side)
+ *
+ * Call this function from the DMA completion (or half-completion)
+ * handler with the block just received. The function returns the number
+ * of bytes added; the rest is counted as overruns.
+ */
+int AD013_RingWrite(AD013_Ring * ring, const byte * data, int data_len);
+
+/* !\brief Returns the number of bytes waiting in the ring */
+int AD013_RingAvailable(const AD013_Ring * ring);
+
+/* !\brief Removes one byte from the ring (consumer side)
+ *
+ * The function returns the byte or -1 if the ring is empty.
+ */
+int AD013_RingPop(AD013_Ring * ring);
+
+
+/* !\brief Initializes (resets) a frame parser */
+void AD013_ParserInit(AD013_Parser * parser);
+
+/* !\brief Feeds received bytes to the frame parser
+ *
+ * The parser consumes bytes until a complete, valid frame (ACK or data
+ * packet) is available; the number of consumed bytes is returned in
+ * consumed. Bytes that do not belong to a frame and frames with a bad
+ * checksum are dropped.
+ *
+ * The function returns 1 when a frame is available (see
+ * AD013_ParserFlag() and AD013_ParserData()), 0 if more bytes are needed.
+ * Call AD013_ParserNext() once the frame has been used.
+ */
+int AD013_ParserFeed(AD013_Parser * parser,
+                     const byte   * data,
+                     int            data_len,
+                     int          * consumed = NULL);
+
+/* !\brief Feeds the frame parser from a receive ring
+ *
+ * Same as AD013_ParserFeed(), the bytes are taken from the ring (consumer
+ * side) until a frame is available or the ring is empty.
+ */
+int AD013_ParserDrain(AD013_Parser * parser, AD013_Ring * ring);
+
+/* !\brief Returns a view of the next frame waiting in a receive ring
+ *
+ * The frame at the consumer side of the ring is validated (length and
+ * checksum) in place and the view points directly into the ring, so no
+ * copy is made. Only when the frame wraps around the end of the ring, it
+ * is copied into the parser's frame buffer. Bytes that do not belong to
+ * a valid frame are dropped.
+ *
+ * The view stays valid until AD013_ParserRelease() is called, in the
+ * meanwhile the producer keeps filling the ring behind the frame.
+ *
+ * The function returns 1 when a frame is available, 0 if more bytes are
+ * needed.
+ */
+int AD013_ParserPeek(AD013_Parser    * parser,
+                     AD013_Ring      * ring,
+                     AD013_FrameView * view);
+
+/* !\brief Removes the frame returned by AD013_ParserPeek() from the ring */
+void AD013_ParserRelease(AD013_Parser          * parser,
+                         AD013_Ring            * ring,
+                         const AD013_FrameView * view);
+
+/* !\brief Releases the current frame and starts looking for the next */
+void AD013_ParserNext(AD013_Parser * parser);
+
+/* !\brief Returns the Packet Identifier (Flag) of the current frame */
+#define AD013_ParserFlag(p) \
+  ((p)->frame[AD013_MSG_OFFSET_FLAG])
+
+/* !\brief Returns the Code/Data of the current frame */
+#define AD013_ParserData(p) \
+  ((const byte *)(p)->frame + AD013_MSG_OFFSET_CODE)
+
+/* !\brief Returns the size of the Code/Data of the current frame */
+#define AD013_ParserDataLen(p) \
+  ((p)->len - AD013_MSG_OFFSET_CODE - 2)
+
+
+// Stream over a receive ring
+//
+// Reads come from the ring filled by the RX interrupt/DMA, writes go
+// to the TX port. Use it as the SerialPort of the blocking functions
+// so that no byte is lost while the CPU is busy elsewhere. The data
+// packets of multi-packet transfers are validated in place in the
+// ring (see AD013_RingStreamOf()).
+class AD013_RingStream : public Stream {
+
+  public:
+    AD013_RingStream(AD013_Ring * ring, Print & tx);
+    ~AD013_RingStream();
+
+    AD013_Ring * ring() { return _ring; }
+    AD013_Parser * parser() { return &_parser; }
+
+    virtual int available() { return AD013_RingAvailable(_ring); }
+    virtual int read() { return AD013_RingPop(_ring); }
+    virtual int peek();
+    virtual void flush() { _tx.flush(); }
+
+    virtual size_t write(uint8_t c) { return _tx.write(c); }
+    virtual size_t write(const uint8_t * buff, size_t size) { return _tx.write(buff, size); }
+    using Print::write;
+
+  protected:
+    AD013_Ring       * _ring;
+    Print            & _tx;
+    AD013_Parser       _parser; /* Frames wrapping the end of the ring */
+    AD013_RingStream * _next;   /* Next AD013_RingStream (see AD013_RingStreamOf()) */
+
+    friend AD013_RingStream * AD013_RingStreamOf(Stream & SensorCom);
+};
+
+/* !\brief Returns the AD013_RingStream behind a Stream
+ *
+ * The data packets received over an AD013_RingStream are handed over as
+ * views into its ring (see AD013_ParserPeek()) instead of being read
+ * byte by byte.
+ *
+ * The function returns the AD013_RingStream or NULL if SensorCom is any
+ * other Stream.
+ */
+AD013_RingStream * AD013_RingStreamOf(Stream & SensorCom);
+
+#endif // AD013_FINGERPRINT_TRANSPORT_HEADER
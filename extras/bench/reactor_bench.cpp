@@ -0,0 +1,202 @@
+
+// ================================================
+// Capacitative Fingerprint Sensor Library
+//   (c) 2020 by Massimiliano Pala and CableLabs
+//   All Rights Reserved
+//
+// Fingerprint / RFID / BLE Project
+// ================================================
+
+// Reactor Benchmark (Linux hosts)
+//
+// Drives 1 to 64 simulated sensors from one AD013_Reactor and reports
+// the CPU time used by the reactor's thread as the number of devices
+// grows. Each simulated sensor sits behind a pseudo-terminal and runs
+// in its own thread, answering PS_GetImage with an ACK after a short
+// delay (like a real module), so the devices keep the reactor busy
+// with back-to-back commands.
+//
+// Build (from the library directory, with the host port of the
+// Arduino API providing Arduino.h):
+//
+//   g++ -O2 -I. -I<arduino-api> extras/bench/reactor_bench.cpp \
+//       AD013.cpp AD013_Log.cpp AD013_Transport.cpp AD013_Timer.cpp \
+//       AD013_Reactor.cpp \
+//       <arduino-api sources> -o reactor_bench -lutil -lpthread
+//
+// Usage: reactor_bench [seconds per run] [sensor delay (ms)]
+
+#include "AD013_Reactor.h"
+
+#include <pty.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_MAX_DEVICES  AD013_REACTOR_MAX_DEVICES
+
+// Simulated Sensor
+typedef struct bench_sensor_st {
+  int          master;     /* Sensor side of the pty */
+  int          slave;      /* Host side of the pty */
+  int          delay;      /* Reply Delay (ms) */
+  volatile int stop;
+  pthread_t    thread;
+} BenchSensor;
+
+// Driven Device
+typedef struct bench_device_st {
+  AD013_Device dev;
+  long         replies;
+  long         errors;
+} BenchDevice;
+
+static void * bench_sensor_run(void * arg) {
+
+  BenchSensor * sensor = (BenchSensor *) arg;
+  AD013_Parser parser;
+  struct pollfd pfd = { sensor->master, POLLIN, 0 };
+  byte buff[256];
+  byte ack[12] = { 0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x07, 0x00, 0x03, 0x00 };
+  uint16_t sum = AD013_Sum(0, ack + AD013_MSG_OFFSET_FLAG, 4);
+  int consumed = 0;
+  int pos = 0;
+  int len = 0;
+
+  ack[10] = sum >> 8;
+  ack[11] = sum & 0xFF;
+
+  AD013_ParserInit(&parser);
+
+  while (!sensor->stop) {
+
+    if (poll(&pfd, 1, 50) <= 0) continue;
+    if ((len = read(sensor->master, buff, sizeof(buff))) <= 0) continue;
+
+    // One ACK (Code OK) per command
+    for (pos = 0; pos < len; pos += consumed) {
+      if (AD013_ParserFeed(&parser, buff + pos, len - pos, &consumed)) {
+        if (sensor->delay > 0) usleep(sensor->delay * 1000);
+        if (write(sensor->master, ack, sizeof(ack)) != sizeof(ack)) break;
+        AD013_ParserNext(&parser);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+static void bench_reply(AD013_Device * dev, int code, const byte * data, long data_len, void * ctx) {
+
+  BenchDevice * bdev = (BenchDevice *) ctx;
+
+  if (code == AD013_CODE_OK) {
+    bdev->replies++;
+  } else {
+    bdev->errors++;
+  }
+
+  // Next command, right away
+  AD013_DeviceCommand(dev, 0x01, NULL, bench_reply, bdev);
+}
+
+static double bench_cpu_ms(void) {
+
+  struct rusage usage;
+
+  // Reactor's thread only (the simulated sensors run elsewhere)
+  getrusage(RUSAGE_THREAD, &usage);
+
+  return usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0 +
+         usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+}
+
+static int bench_run(int count, int seconds, int delay) {
+
+  static BenchSensor sensors[BENCH_MAX_DEVICES];
+  static BenchDevice devices[BENCH_MAX_DEVICES];
+  AD013_Reactor reactor;
+  struct termios tio;
+  unsigned long start = 0;
+  unsigned long elapsed = 0;
+  double cpu = 0;
+  long replies = 0;
+  long errors = 0;
+  int i = 0;
+
+  if (AD013_ReactorInit(&reactor) < 0) return -1;
+
+  for (i = 0; i < count; i++) {
+
+    memset(&sensors[i], 0, sizeof(BenchSensor));
+    if (openpty(&sensors[i].master, &sensors[i].slave, NULL, NULL, NULL) < 0) {
+      perror("openpty");
+      return -1;
+    }
+
+    // Raw mode on both sides
+    tcgetattr(sensors[i].master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(sensors[i].master, TCSANOW, &tio);
+    tcsetattr(sensors[i].slave, TCSANOW, &tio);
+
+    sensors[i].delay = delay;
+    pthread_create(&sensors[i].thread, NULL, bench_sensor_run, &sensors[i]);
+
+    memset(&devices[i], 0, sizeof(BenchDevice));
+    AD013_ReactorAdd(&reactor, &devices[i].dev, sensors[i].slave);
+  }
+
+  for (i = 0; i < count; i++) {
+    AD013_DeviceCommand(&devices[i].dev, 0x01, NULL, bench_reply, &devices[i]);
+  }
+
+  cpu = bench_cpu_ms();
+  start = millis();
+  while ((elapsed = millis() - start) < (unsigned long) seconds * 1000) {
+    AD013_ReactorPoll(&reactor, 100);
+  }
+  cpu = bench_cpu_ms() - cpu;
+
+  for (i = 0; i < count; i++) {
+    replies += devices[i].replies;
+    errors += devices[i].errors;
+  }
+
+  printf("%7d %10.0f %9ld %9.1f %11.2f %10.2f\n", count,
+         replies * 1000.0 / elapsed, errors, cpu * 100.0 / elapsed,
+         replies ? cpu * 1000.0 / replies : 0.0,
+         replies ? (double) reactor.wakeups / replies : 0.0);
+
+  AD013_ReactorClose(&reactor);
+
+  for (i = 0; i < count; i++) {
+    sensors[i].stop = 1;
+    pthread_join(sensors[i].thread, NULL);
+    close(sensors[i].master);
+    close(sensors[i].slave);
+  }
+
+  return 1;
+}
+
+int main(int argc, char ** argv) {
+
+  int seconds = argc > 1 ? atoi(argv[1]) : 3;
+  int delay = argc > 2 ? atoi(argv[2]) : 2;
+
+  printf("Sensor Delay: %d ms, %d s per run\n\n", delay, seconds);
+  printf("%7s %10s %9s %9s %11s %10s\n",
+         "Devices", "Cmds/s", "Errors", "CPU %", "CPU us/Cmd", "Wake/Cmd");
+
+  for (int count = 1; count <= BENCH_MAX_DEVICES; count *= 2) {
+    if (bench_run(count, seconds, delay) < 0) return 1;
+  }
+
+  return 0;
+}